@@ -0,0 +1,115 @@
+"""Checks that vocabserv makes no allocations for connections in steady state
+
+Needs a build configured with -DVOCABSERV_COUNT_ALLOCS=ON, which counts calls to operator new on
+worker threads in api/metrics. The server is warmed up with rounds of connections (each making
+keep-alive and pipelined requests over a mix of routes), then given one more round; the check fails
+if that round allocated. The client reads the connections one after the other; with a vocab of
+megabytes, fewer --connections keep each of them from idling past the server's keep-alive timeout.
+Usage example, for the read/write path and then the sendfile one:
+
+    cmake -B build-allocs -S . -DVOCABSERV_COUNT_ALLOCS=ON ... && cmake --build build-allocs
+    python scripts/alloc_check.py vocab.gz build-allocs
+    python scripts/alloc_check.py vocab.gz build-allocs --server-args='--load=mmap --send=sendfile'
+"""
+import argparse
+import os
+import re
+import socket
+import subprocess
+import sys
+import time
+
+ap = argparse.ArgumentParser()
+ap.add_argument('vocab')
+ap.add_argument('build', help='build directory')
+ap.add_argument('--connections', type=int, default=100, help='at once, per round')
+ap.add_argument('--requests', type=int, default=20, help='per connection')
+ap.add_argument('--warmup', type=int, default=3, help='rounds')
+ap.add_argument('--port', type=int, default=8080)
+ap.add_argument('--log-dir', help='of the server, for access logging to be checked as well')
+ap.add_argument('--server-args', default='',
+                help='more options of the server, e.g. "--load=mmap --send=sendfile"')
+args = ap.parse_args()
+
+targets = ['/', '/index.js', '/index.css', '/api/vocabVer', '/api/vocab', '/api/search?q=a',
+           '/missing']
+# Pipelined after the vocab in identity coding, which may be sent from its file: responses made
+# of headers only, ending the batch
+after_file = [('/api/vocab', ''), ('/missing', ''), ('/api/vocab', 'if-none-match: *\r\n')]
+
+
+def request(target, encoding='gzip, br', extra=''):
+    return (f'GET {target} HTTP/1.1\r\nhost: localhost\r\naccept-encoding: {encoding}\r\n'
+            f'{extra}\r\n').encode()
+
+
+def read_response(s, buf):
+    """Reads one response off a socket; returns its body and what's left of the buffer"""
+    while b'\r\n\r\n' not in buf:
+        d = s.recv(65536)
+        if not d:
+            raise ConnectionError('closed mid-response')
+        buf += d
+    head, buf = buf.split(b'\r\n\r\n', 1)
+    m = re.search(rb'(?im)^content-length:\s*(\d+)', head)
+    n = int(m.group(1)) if m else 0  # a 304 has no body
+    # Collected in pieces and joined once, as a large body would be copied over and over
+    parts, have = [buf], len(buf)
+    while have < n:
+        d = s.recv(1 << 20)
+        if not d:
+            raise ConnectionError('closed mid-body')
+        parts.append(d)
+        have += len(d)
+    buf = b''.join(parts)
+    return buf[:n], buf[n:]
+
+
+def round_():
+    """Connections open at once, each making requests one at a time, then some pipelined"""
+    socks = [socket.create_connection(('localhost', args.port)) for _ in range(args.connections)]
+    bufs = [b''] * len(socks)
+    for k in range(args.requests):
+        for i, s in enumerate(socks):
+            s.sendall(request(targets[(i + k) % len(targets)], ['gzip', 'br', ''][k % 3]))
+        for i, s in enumerate(socks):
+            _, bufs[i] = read_response(s, bufs[i])
+    for batch in [[request(t) for t in targets], [request(t, '', x) for t, x in after_file]]:
+        for s in socks:
+            s.sendall(b''.join(batch))
+        for i, s in enumerate(socks):
+            for _ in batch:
+                _, bufs[i] = read_response(s, bufs[i])
+    for s in socks:
+        s.close()
+    time.sleep(0.5)  # for the server to see the connections end
+
+
+def allocations():
+    with socket.create_connection(('localhost', args.port)) as s:
+        s.sendall(request('/api/metrics', ''))
+        body, _ = read_response(s, b'')
+        return int(re.search(rb'(?m)^vocabserv_allocations_total (\d+)', body).group(1))
+
+
+server = subprocess.Popen([os.path.join(args.build, 'src', 'vocabserv'), '--workers=1',
+                           *args.server_args.split(), args.vocab, str(args.port),
+                           *([args.log_dir] if args.log_dir else [])],
+                          stdout=subprocess.DEVNULL)
+try:
+    time.sleep(1)  # for the vocab to load
+    for _ in range(args.warmup):
+        round_()
+    # What reading the metrics allocates is taken out
+    a0 = allocations()
+    a1 = allocations()
+    round_()
+    a2 = allocations()
+finally:
+    server.terminate()
+    server.wait()
+n = a2 - a1 - (a1 - a0)
+print(f'{n} allocations in {args.connections} connections of '
+      f'{args.requests + len(targets) + len(after_file)} requests each, after {args.warmup} rounds '
+      'of warmup')
+sys.exit(n > 0)
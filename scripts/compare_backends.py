@@ -0,0 +1,58 @@
+"""Compares vocabserv builds (e.g. of two configurations) under vocabserv-load
+
+Each build's server is started in turn on the same vocabulary and loaded at every connection
+count; throughput and corrected latency percentiles are tabulated side by side. Usage example:
+
+    cmake -B build-a -S . ... && cmake --build build-a
+    cmake -B build-b -S . -DCMAKE_BUILD_TYPE=RelWithDebInfo ... && cmake --build build-b
+    python scripts/compare_backends.py vocab.gz build-a build-b --connections 1000 10000
+"""
+import argparse
+import os
+import re
+import subprocess
+import time
+
+ap = argparse.ArgumentParser()
+ap.add_argument('vocab')
+ap.add_argument('builds', nargs='+', help='build directories; the first one provides the load tool')
+ap.add_argument('--connections', type=int, nargs='+', default=[100, 1000, 10000])
+ap.add_argument('--workers', type=int, default=os.cpu_count())
+ap.add_argument('--threads', type=int, default=max(1, os.cpu_count() // 2), help='of the load tool')
+ap.add_argument('--pipeline', type=int, default=1)
+ap.add_argument('--duration', type=float, default=20)
+ap.add_argument('--port', type=int, default=8080)
+args = ap.parse_args()
+
+load = os.path.join(args.builds[0], 'src', 'vocabserv-load')
+quantiles = ['p50', 'p99', 'p99.9']
+
+
+def run(build, connections):
+    """Throughput and corrected latencies (in us) of a build at a connection count"""
+    server = subprocess.Popen([os.path.join(build, 'src', 'vocabserv'), f'--workers={args.workers}',
+                               f'--read-bufs={connections}', args.vocab, str(args.port)],
+                              stdout=subprocess.DEVNULL)
+    try:
+        time.sleep(1)  # for the vocab to load
+        out = subprocess.run([load, f'--connections={connections}', f'--threads={args.threads}',
+                              f'--pipeline={args.pipeline}', f'--duration={args.duration}',
+                              f'--warmup={min(2, args.duration / 4)}', 'localhost', str(args.port)],
+                             check=True, capture_output=True, text=True).stdout
+    finally:
+        server.terminate()
+        server.wait()
+    rps = float(re.search(r'([\d.]+) requests/s', out).group(1))
+    lat = {m.group(1): float(m.group(2))
+           for m in re.finditer(r'^(p[\d.]+)\s+[\d.]+ us\s+([\d.]+) us$', out, re.M)}
+    return rps, [lat[q] for q in quantiles]
+
+
+results = {b: [run(b, c) for c in args.connections] for b in args.builds}
+name_w = max(len(b) for b in args.builds)
+print(f'{"connections":>11}  {"build":<{name_w}} {"requests/s":>12}' +
+      ''.join(f' {q + " us":>10}' for q in quantiles))
+for i, c in enumerate(args.connections):
+    for b in args.builds:
+        rps, lat = results[b][i]
+        print(f'{c:>11}  {b:<{name_w}} {rps:>12.0f}' + ''.join(f' {l:>10.1f}' for l in lat))
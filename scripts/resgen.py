@@ -1,5 +1,6 @@
 import argparse
 import gzip
+import hashlib
 import os
 import sys
 from contextlib import suppress
@@ -16,6 +17,17 @@ if not args.debug:
         import minify_html
         minify = True
 
+# content-codings in the order of the `coding` enum; a coding whose module is missing is skipped
+codings = [lambda b: b, lambda b: gzip.compress(b, compresslevel=9, mtime=0), None, None]
+with suppress(ImportError):
+    import brotli
+    codings[2] = lambda b: brotli.compress(b, mode=brotli.MODE_TEXT, quality=11, lgwin=24)
+with suppress(ImportError):
+    import zstandard
+    # decoders of the zstd content-coding may reject windows over 8 MiB (RFC 9659)
+    zparams = zstandard.ZstdCompressionParameters.from_level(22, window_log=23)
+    codings[3] = zstandard.ZstdCompressor(compression_params=zparams).compress
+
 def namecnv(name):
     return name.lstrip('res').rstrip('index.html')
 def get_file(name):
@@ -28,22 +40,41 @@ hdr = """#include <string_view>
 
 namespace res {{
 constexpr inline std::array<std::string_view, {0}> names{{{1}}};
-extern const std::array<std::string_view, {0}> contents;
+// variants are indexed by coding (identity, gzip, br, zstd); empty if not generated
+constexpr inline std::array<std::array<std::string_view, 4>, {0}> etags{{{{{2}}}}};
+extern const std::array<std::array<std::string_view, 4>, {0}> contents;
 }}"""
 src = """#include "res.h"
 
-const std::array<std::string_view, {}> res::contents{{{}}};
+const std::array<std::array<std::string_view, 4>, {}> res::contents{{{{{}}}}};
 """
 
+def variants(cont):
+    if minify:
+        cont = minify_html.minify(cont, minify_css=True, minify_js=True)
+    cont = cont.encode('U8')
+    return [f(cont) if f else None for f in codings]
+contents = list(map(variants, contents))
+
+# strong validators of the served bytes
+def etag(cont):
+    if cont is None:
+        return '""'
+    return '"\\"' + hashlib.blake2b(cont, digest_size=8).hexdigest() + '\\""'
+def etags(vars):
+    return '{' + ','.join(map(etag, vars)) + '}'
+
 with open(os.path.join(args.dst, 'res.h'), 'w') as f:
     f.write(hdr.format(len(names),
-                       ','.join(f'"{name}"' for name in names)))
+                       ','.join(f'"{name}"' for name in names),
+                       ','.join(map(etags, contents))))
 
 def contcnv(cont):
-    if minify:
-        cont = minify_html.minify(cont, minify_css=True, minify_js=True)
-    cont = gzip.compress(cont.encode('U8'))
+    if cont is None:
+        return 'std::string_view{}'
     return 'std::string_view{"' + ''.join(f'\\{x:o}' for x in cont) + f'",{len(cont)}}}'
+def varcnv(vars):
+    return '{' + ','.join(map(contcnv, vars)) + '}'
 with open(os.path.join(args.dst, 'res.cpp'), 'w') as f:
     f.write(src.format(len(names),
-                       ','.join(map(contcnv, contents))))
+                       ','.join(map(varcnv, contents))))
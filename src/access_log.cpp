@@ -0,0 +1,46 @@
+#include "access_log.h"
+
+#include <string.h>
+
+namespace sc = std::chrono;
+
+bool alog::access_log::init(const char *const dir)
+{
+    ns_per_tick = 1e3 / ticks::per_us();
+    base_ticks  = ticks::now();
+    base_ns =
+        sc::duration_cast<sc::nanoseconds>(sc::system_clock::now().time_since_epoch()).count();
+
+    file_header fh{};
+    memcpy(fh.magic, magic, sizeof(magic));
+    fh.version      = version;
+    fh.request_size = sizeof(request);
+    lg.header.assign(reinterpret_cast<const char *>(&fh), sizeof(fh));
+    return lg.init(dir);
+}
+
+uint32_t alog::access_log::define(slot &s, std::string_view path)
+{
+    const auto fresh = !s.id;
+    if (fresh)
+        s.id = next_id.fetch_add(1, std::memory_order_relaxed);
+    path = path.substr(0, max_target);
+
+    // Padded to keep the records that follow 4-byte aligned
+    char rec[sizeof(target) + max_target + 3];
+    const auto size = (sizeof(target) + path.size() + 3) & ~3_uz;
+    const target tr{{kind::target, 0, static_cast<uint16_t>(size)}, s.id};
+    memcpy(rec, &tr, sizeof(tr));
+    memcpy(rec + sizeof(tr), path.data(), path.size());
+    memset(rec + sizeof(tr) + path.size(), 0, size - sizeof(tr) - path.size());
+
+    // Files started from now on begin with the definition, and the current one gets it queued.
+    // It's added to the header first: a file started in between would otherwise miss it, as the
+    // writer may write the queued record to the file before and then start the next one.
+    if (fresh)
+        lg.append_header(rec, size);
+    if (!lg.push(rec, size))
+        return 0; // pushed again next time
+    s.pushed = true;
+    return s.id;
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <span>
+#include <stdint.h>
+#include <string_view>
+
+#include "jutil.h"
+#include "log.h"
+#include "ticks.h"
+
+//! @brief Binary access log, written to <n>.alog files in the log directory
+//!
+//! A file is a `file_header` followed by records, each beginning with a `head`, in the byte order
+//! of the host. Targets are interned: a `target` record defines an id, which `request` records
+//! then refer to. A file begins with the definitions made before it was started, and so decodes
+//! on its own. Targets are drawn from a fixed set (the server's routes), so that the definitions
+//! stay few however many paths clients make up.
+namespace alog
+{
+inline constexpr char magic[8]{'V', 'S', 'A', 'L', 'O', 'G', '\0', '\0'};
+inline constexpr uint32_t version = 1;
+
+struct file_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t request_size; // sizeof(request), as a check of the layout
+};
+
+enum class kind : uint8_t { request = 1, target = 2 };
+struct head {
+    kind k;
+    uint8_t reserved;
+    uint16_t size; // of the whole record
+};
+
+//! @brief Defines a target id; followed by `h.size - sizeof(target)` bytes of the target
+struct target {
+    head h;
+    uint32_t id;
+};
+inline constexpr auto max_target = 256_uz; // longer ones are truncated
+
+enum phase : uint8_t {
+    read,  // from the first bytes of the request (or its batch) to the last
+    parse, // parsing the request
+    serve, // generating the response
+    write, // writing the responses of the batch
+    nphases
+};
+inline constexpr std::array<std::string_view, nphases> phase_names{"read", "parse", "serve",
+                                                                   "write"};
+
+struct request {
+    head h;
+    uint32_t target;       // id of the path (without query), or 0 if it isn't a target
+    int64_t time;          // Unix time in ns at which serving began
+    uint32_t peer;         // IPv4 address, or 0
+    uint32_t bytes;        // of the response
+    uint32_t lat[nphases]; // in ns; saturated
+    uint16_t status;
+    uint8_t method; // `method` of message.h
+    uint8_t reserved[5];
+};
+static_assert(sizeof(request) == 48);
+
+//! @brief Writer of the access log; the records of every thread go through its rings
+struct access_log {
+    static constexpr auto max_targets = 256_uz; // keys of `intern`
+
+    //! @brief Starts logging to the directory
+    bool init(const char *dir);
+    [[nodiscard]] JUTIL_INLINE bool enabled() const noexcept { return lg.running(); }
+
+    //! @brief Id of a target, defining it first if this thread hasn't yet
+    //! @param key Index of the target, below `max_targets`; the same one always has the same path
+    [[nodiscard]] JUTIL_INLINE uint32_t intern(const std::size_t key, const std::string_view path)
+    {
+        auto &s = local()[key];
+        return s.pushed ? s.id : define(s, path);
+    }
+
+    //! @brief Unix time in ns at given tick
+    [[nodiscard]] JUTIL_INLINE int64_t unix_ns(const uint64_t t) const noexcept
+    {
+        return base_ns + static_cast<int64_t>(static_cast<double>(t - base_ticks) * ns_per_tick);
+    }
+    //! @brief Ns, as already converted from ticks for the metrics, saturated to fit a latency
+    //! field
+    [[nodiscard]] static JUTIL_INLINE uint32_t lat_ns(const uint64_t ns) noexcept
+    {
+        return ns < UINT32_MAX ? static_cast<uint32_t>(ns) : UINT32_MAX;
+    }
+
+    JUTIL_INLINE void push(const std::span<const request> rs) noexcept
+    {
+        lg.push(rs.data(), rs.size_bytes());
+    }
+    [[nodiscard]] JUTIL_INLINE uint64_t dropped() const noexcept { return lg.dropped(); }
+
+  private:
+    //! @brief Id of a target in this thread, 0 until defined
+    struct slot {
+        uint32_t id;
+        bool pushed; // whether the definition has been queued, rather than dropped
+    };
+    [[nodiscard]] static JUTIL_INLINE std::array<slot, max_targets> &local()
+    {
+        thread_local std::array<slot, max_targets> t{};
+        return t;
+    }
+    uint32_t define(slot &s, std::string_view path);
+
+    detail::log lg{detail::log_format::binary};
+    std::atomic<uint32_t> next_id{1};
+    double ns_per_tick  = 1;
+    int64_t base_ns     = 0;
+    uint64_t base_ticks = 0;
+};
+} // namespace alog
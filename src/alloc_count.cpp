@@ -0,0 +1,25 @@
+#include "alloc_count.h"
+
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+
+namespace
+{
+std::atomic<uint64_t> g_n;
+thread_local bool t_on;
+} // namespace
+
+uint64_t alloc_count::get() noexcept { return g_n.load(std::memory_order_relaxed); }
+void alloc_count::enable() noexcept { t_on = true; }
+
+void *operator new(const std::size_t n)
+{
+    if (t_on)
+        g_n.fetch_add(1, std::memory_order_relaxed);
+    if (const auto p = malloc(n ? n : 1)) [[likely]]
+        return p;
+    throw std::bad_alloc{};
+}
+void operator delete(void *const p) noexcept { free(p); }
+void operator delete(void *const p, std::size_t) noexcept { free(p); }
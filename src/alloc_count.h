@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stdint.h>
+
+//! @brief Counting of calls to operator new (aligned ones aside), in builds with
+//! VOCABSERV_COUNT_ALLOCS; used to check that connections make none in steady state
+namespace alloc_count
+{
+//! @brief Calls made so far on the threads counted
+[[nodiscard]] uint64_t get() noexcept;
+//! @brief Counts the calls made on the calling thread from now on
+void enable() noexcept;
+} // namespace alloc_count
@@ -0,0 +1,54 @@
+#include "bench.h"
+
+#include <array>
+#include <filesystem>
+#include <string_view>
+#include <vector>
+
+#include "../access_log.h"
+
+namespace sf = std::filesystem;
+
+namespace
+{
+constexpr std::array<std::string_view, 4> targets{"/", "/index.js", "/api/search", "/api/vocab"};
+
+//! @brief Log writing to a fresh directory, as the server's does
+alog::access_log &log()
+{
+    static auto &l = [] -> alog::access_log & {
+        const auto dir = sf::temp_directory_path() / "vocabserv_bench_alog";
+        sf::remove_all(dir);
+        sf::create_directories(dir);
+        static alog::access_log l;
+        l.init(dir.string().c_str());
+        return l;
+    }();
+    return l;
+}
+} // namespace
+
+//! @brief Work added to a request by logging it: filling in the record with the target interned,
+//! and pushing it as a batch of one. The clock readings and their conversion to ns are left out,
+//! as the server shares them with the metrics (see metrics/request). The loop outruns the writer,
+//! so most pushes find the ring full and are dropped; one that's queued copies the record too.
+BENCH("access_log/request")
+{
+    auto &l = log();
+    std::vector<alog::request> recs;
+    recs.reserve(1);
+    const auto t = ticks::now();
+    for (auto i = 0_uz; i < n; ++i) {
+        auto &r  = recs.emplace_back();
+        r.h      = {alog::kind::request, 0, sizeof(alog::request)};
+        r.target = l.intern(i % targets.size(), targets[i % targets.size()]);
+        r.time   = l.unix_ns(t + i);
+        r.bytes  = static_cast<uint32_t>(i);
+        for (auto p = 0_uz; p < alog::nphases; ++p)
+            r.lat[p] = alog::access_log::lat_ns(i >> p);
+        r.status = 200;
+        l.push(recs);
+        recs.clear();
+    }
+    return 0;
+}
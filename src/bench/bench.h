@@ -0,0 +1,51 @@
+#pragma once
+
+#include <chrono>
+#include <stdint.h>
+#include <vector>
+
+#include "../jutil.h"
+
+//! @brief Minimal microbenchmark harness
+//!
+//! Usage example:
+//!
+//!     BENCH("format/int")
+//!     {
+//!         for (auto i = 0_uz; i < n; ++i)
+//!             bench::keep(format::format(buf, i));
+//!         return 0; // bytes processed, or 0 if throughput is meaningless
+//!     }
+//!
+namespace bench
+{
+//! @brief Benchmark body; runs n operations and returns the number of bytes they processed
+using fn = std::size_t (*)(std::size_t n);
+
+struct entry {
+    const char *name;
+    fn f;
+};
+std::vector<entry> &registry();
+JUTIL_INLINE bool add(const char *const name, const fn f)
+{
+    registry().push_back({name, f});
+    return true;
+}
+
+//! @brief Keeps the compiler from optimizing a value (and the computation of it) away
+template <class T>
+JUTIL_INLINE void keep(T &&x) noexcept
+{
+#ifdef _MSC_VER
+    static_cast<void>(*reinterpret_cast<const volatile char *>(&x));
+#else
+    asm volatile("" : : "r,m"(x) : "memory");
+#endif
+}
+} // namespace bench
+
+#define BENCH(Name)                                                                                \
+    static std::size_t CAT(bench_, __LINE__)(std::size_t);                                         \
+    static const bool CAT(bench_reg_, __LINE__) = bench::add(Name, CAT(bench_, __LINE__));         \
+    static std::size_t CAT(bench_, __LINE__)([[maybe_unused]] const std::size_t n)
@@ -0,0 +1,163 @@
+#include "bench.h"
+
+#include <array>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../buffer.h"
+#include "../format.h"
+#include "../rope.h"
+
+namespace
+{
+//! @brief Values as formatted by the server: mostly content lengths and counts of a few digits,
+//! with the odd large one
+const std::vector<uint32_t> &values()
+{
+    static const auto vs = [] {
+        std::mt19937 rng{42};
+        std::lognormal_distribution<double> d{6.0, 2.5};
+        std::vector<uint32_t> r(4096);
+        for (auto &x : r)
+            x = static_cast<uint32_t>(std::min(d(rng), 4e9));
+        return r;
+    }();
+    return vs;
+}
+
+//! @brief Targets of requests for missing resources, some with characters to escape
+constexpr std::array<std::string_view, 4> targets{
+    "/favicon.ico",
+    "/wp-login.php?redirect_to=http%3A%2F%2Fexample.com%2Fwp-admin%2F&reauth=1",
+    "/search?q=<script>alert(1)</script>&a=1&b=2",
+    "/api/v1/users/12345/profile",
+};
+
+//! @brief A line of a search result, appended 1k times to a body of about 64 KiB
+constexpr std::string_view line =
+    "\"a-word-of-the-vocab\",\"its meaning in a few words, quite briefly\"\n";
+} // namespace
+
+BENCH("format/itoa")
+{
+    char buf[16];
+    const auto &vs = values();
+    for (auto i = 0_uz; i < n; ++i)
+        bench::keep(format::format(buf, vs[i % vs.size()]));
+    return 0;
+}
+
+BENCH("format/fmt_width")
+{
+    char buf[16];
+    const auto &vs = values();
+    for (auto i = 0_uz; i < n; ++i) {
+        const auto x = vs[i % vs.size()];
+        bench::keep(format::format(buf, format::fmt_width<2>(x % 100), format::fmt_width<4>(x % 10000),
+                                   format::fmt_width<9>(x % 1'000'000'000)));
+    }
+    return 0;
+}
+
+BENCH("format/timestamp")
+{
+    char buf[format::maxsz(format::hdr_time{})];
+    for (auto i = 0_uz; i < n; ++i)
+        bench::keep(format::format(buf, format::hdr_time{}));
+    return 0;
+}
+
+BENCH("format/escape")
+{
+    char buf[512];
+    std::size_t nbytes = 0;
+    for (auto i = 0_uz; i < n; ++i) {
+        const auto t = targets[i % targets.size()];
+        bench::keep(format::format(buf, format::escaped{t}));
+        nbytes += t.size();
+    }
+    return nbytes;
+}
+
+//! @brief A response header as the server builds one, appended to a reused buffer
+BENCH("buffer/put")
+{
+    buffer b;
+    const auto &vs = values();
+    for (auto i = 0_uz; i < n; ++i) {
+        if (i % 64 == 0)
+            b.clear();
+        b.put<true>("HTTP/1.1 200 OK\r\ncontent-type: text/plain; charset=UTF-8\r\n"
+                    "connection: keep-alive\r\ncontent-length: ",
+                    vs[i % vs.size()], "\r\n\r\n");
+    }
+    bench::keep(b.size());
+    return 0;
+}
+
+//! @brief As buffer/put, appended to a reused rope
+BENCH("rope/put")
+{
+    rope b;
+    const auto &vs = values();
+    for (auto i = 0_uz; i < n; ++i) {
+        if (i % 64 == 0)
+            b.clear();
+        b.put<true>("HTTP/1.1 200 OK\r\ncontent-type: text/plain; charset=UTF-8\r\n"
+                    "connection: keep-alive\r\ncontent-length: ",
+                    vs[i % vs.size()], "\r\n\r\n");
+    }
+    bench::keep(b.size());
+    return 0;
+}
+
+//! @brief A body of about 64 KiB built line by line into a new buffer, which is grown (and its
+//! contents copied) on the way; per body
+BENCH("buffer/grow_64k")
+{
+    std::size_t nbytes = 0;
+    for (auto i = 0_uz; i < n; ++i) {
+        buffer b;
+        for (auto j = 0; j < 1024; ++j)
+            b.put<true>(line);
+        nbytes += b.size();
+    }
+    return nbytes;
+}
+
+//! @brief As buffer/grow_64k, into a new rope
+BENCH("rope/grow_64k")
+{
+    std::size_t nbytes = 0;
+    for (auto i = 0_uz; i < n; ++i) {
+        rope b;
+        for (auto j = 0; j < 1024; ++j)
+            b.put<true>(line);
+        nbytes += b.size();
+    }
+    return nbytes;
+}
+
+//! @brief A 32 KiB target escaped into a reused buffer, which reserves 5 times its size
+BENCH("buffer/escape_32k")
+{
+    static const std::string t(32768, '<');
+    buffer b;
+    for (auto i = 0_uz; i < n; ++i)
+        b.put(format::escaped{t});
+    bench::keep(b.size());
+    return n * t.size();
+}
+
+//! @brief As buffer/escape_32k, into a reused rope, which takes the escaped form in slices
+BENCH("rope/escape_32k")
+{
+    static const std::string t(32768, '<');
+    rope b;
+    for (auto i = 0_uz; i < n; ++i)
+        b.put(format::escaped{t});
+    bench::keep(b.size());
+    return n * t.size();
+}
@@ -0,0 +1,21 @@
+#include "bench.h"
+
+#include <array>
+#include <stdint.h>
+
+#include "../jutil.h"
+
+namespace
+{
+constexpr std::array<uint16_t, 8> statuses{200, 304, 400, 404, 405, 413, 503, 505};
+//! @brief Statuses of a typical mix of responses, a few of them not in the table
+constexpr std::array<uint16_t, 16> mix{200, 200, 304, 200, 404, 200, 304, 200,
+                                       200, 400, 200, 304, 200, 206, 200, 500};
+} // namespace
+
+BENCH("jutil/find_unrl")
+{
+    for (auto i = 0_uz; i < n; ++i)
+        bench::keep(find_unrl_idx(statuses, mix[i % mix.size()]));
+    return 0;
+}
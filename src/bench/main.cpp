@@ -0,0 +1,127 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string_view>
+#include <vector>
+
+#include "../ticks.h"
+
+namespace sc = std::chrono;
+
+std::vector<bench::entry> &bench::registry()
+{
+    static std::vector<entry> r;
+    return r;
+}
+
+namespace
+{
+struct result {
+    const char *name;
+    std::size_t n, runs; // operations per run, runs measured
+    double med, p99;     // ns per operation
+    double cycles;       // TSC cycles per operation, in the median run
+    std::size_t bytes;   // processed per run
+};
+
+void print_text(const result &r)
+{
+    printf("%-40s %10.1f ns/op %10.1f ns p99 %10.1f cyc/op", r.name, r.med, r.p99, r.cycles);
+    if (r.bytes)
+        printf(" %10.2f GB/s", static_cast<double>(r.bytes) / (r.med * static_cast<double>(r.n)));
+    putchar('\n');
+}
+
+void print_json(const result &r, const bool first)
+{
+    printf("%s\n    {\"name\": \"", first ? "" : ",");
+    for (auto p = r.name; *p; ++p)
+        *p == '"' || *p == '\\' ? printf("\\%c", *p) : putchar(*p);
+    printf("\", \"ops_per_run\": %zu, \"runs\": %zu, \"median_ns\": %.3f, \"p99_ns\": %.3f, "
+           "\"cycles\": %.3f, \"bytes_per_op\": %.3f}",
+           r.n, r.runs, r.med, r.p99, r.cycles,
+           static_cast<double>(r.bytes) / static_cast<double>(r.n));
+}
+} // namespace
+
+//! @brief Runs benchmarks whose name contains the filter
+//!
+//! Usage example:
+//!
+//!     vocabserv_bench [--json] [--runs=<n>] [<filter>]
+//!
+//! Each benchmark is calibrated to take ~1 ms per run, warmed up, then run `runs` times (101 by
+//! default; fewer if that would take more than 2 s, but at least 9). The median and 99th
+//! percentile of the time per operation over the runs are reported, along with TSC cycles per
+//! operation (a steady-clock ns elsewhere) and, where given, throughput. `--json` prints them as
+//! JSON for comparing builds.
+int main(int argc, char **argv)
+{
+    auto json      = false;
+    auto max_runs  = 101_uz;
+    const char *fl = "";
+    for (auto i = 1; i < argc; ++i)
+        if (!strcmp(argv[i], "--json"))
+            json = true;
+        else if (!strncmp(argv[i], "--runs=", 7))
+            max_runs = std::max<std::size_t>(strtoul(argv[i] + 7, nullptr, 10), 1);
+        else
+            fl = argv[i];
+    const std::string_view filter = fl;
+    constexpr auto target         = sc::milliseconds{1};
+    constexpr auto budget         = sc::seconds{2};
+    constexpr auto warmup         = sc::milliseconds{50};
+
+    if (json)
+        printf("{\n  \"tsc_per_us\": %.3f,\n  \"benchmarks\": [", ticks::per_us());
+    auto first = true;
+    for (const auto [name, f] : bench::registry()) {
+        if (std::string_view{name}.find(filter) == std::string_view::npos)
+            continue;
+
+        // Calibrate the number of operations per run; the first call (setting up inputs, filling
+        // caches) isn't timed
+        const auto time = [&](const std::size_t n) {
+            const auto t0 = sc::steady_clock::now();
+            f(n);
+            return sc::steady_clock::now() - t0;
+        };
+        f(1);
+        auto n = 1_uz;
+        for (sc::nanoseconds t; (t = time(n)) < target;)
+            n *= t < target / 16 ? 8 : 2;
+        for (const auto w0 = sc::steady_clock::now(); sc::steady_clock::now() - w0 < warmup;)
+            f(n);
+
+        const auto per_run = time(n);
+        const auto runs    = std::clamp<std::size_t>(
+            static_cast<std::size_t>(budget / std::max(per_run, sc::nanoseconds{1})), 9, max_runs);
+        std::vector<std::pair<double, uint64_t>> rs(runs); // ns, ticks
+        std::size_t bytes = 0;
+        for (auto &[ns, tk] : rs) {
+            const auto t0 = sc::steady_clock::now();
+            const auto k0 = ticks::now();
+            bytes         = f(n);
+            tk            = ticks::now() - k0;
+            ns            = sc::duration<double, std::nano>{sc::steady_clock::now() - t0}.count();
+        }
+        sr::sort(rs);
+        const auto dn  = static_cast<double>(n);
+        const auto med = rs[runs / 2];
+        const auto p99 = rs[static_cast<std::size_t>(ceil(0.99 * static_cast<double>(runs))) - 1];
+        const result r{name, n, runs, med.first / dn, p99.first / dn,
+                       static_cast<double>(med.second) / dn, bytes};
+        if (json)
+            print_json(r, first);
+        else
+            print_text(r);
+        first = false;
+        fflush(stdout);
+    }
+    if (json)
+        printf("\n  ]\n}\n");
+}
@@ -0,0 +1,124 @@
+#include "bench.h"
+
+#include <array>
+#include <string_view>
+#include <vector>
+
+#include "../message.h"
+
+namespace
+{
+//! @brief Request headers as sent by current browsers for a page load and an API call
+constexpr std::array<std::string_view, 3> samples{
+    "GET /api/search?q=apple&n=50 HTTP/1.1\r\n"
+    "Host: localhost:8080\r\n"
+    "Connection: keep-alive\r\n"
+    "sec-ch-ua: \"Chromium\";v=\"130\", \"Google Chrome\";v=\"130\", \"Not?A_Brand\";v=\"99\"\r\n"
+    "sec-ch-ua-mobile: ?0\r\n"
+    "User-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like "
+    "Gecko) Chrome/130.0.0.0 Safari/537.36\r\n"
+    "sec-ch-ua-platform: \"Windows\"\r\n"
+    "Accept: */*\r\n"
+    "Sec-Fetch-Site: same-origin\r\n"
+    "Sec-Fetch-Mode: cors\r\n"
+    "Sec-Fetch-Dest: empty\r\n"
+    "Referer: http://localhost:8080/\r\n"
+    "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+    "Accept-Language: en-US,en;q=0.9,ja;q=0.8\r\n"
+    "\r\n",
+    "GET / HTTP/1.1\r\n"
+    "Host: localhost:8080\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:131.0) Gecko/20100101 Firefox/131.0\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,image/"
+    "png,image/svg+xml,*/*;q=0.8\r\n"
+    "Accept-Language: en-US,en;q=0.5\r\n"
+    "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+    "Connection: keep-alive\r\n"
+    "Upgrade-Insecure-Requests: 1\r\n"
+    "Sec-Fetch-Dest: document\r\n"
+    "Sec-Fetch-Mode: navigate\r\n"
+    "Sec-Fetch-Site: none\r\n"
+    "Sec-Fetch-User: ?1\r\n"
+    "If-None-Match: \"3f9a1c0e5b7d2468\"\r\n"
+    "Priority: u=0, i\r\n"
+    "\r\n",
+    "GET /api/vocab HTTP/1.1\r\n"
+    "Host: localhost:8080\r\n"
+    "Connection: keep-alive\r\n"
+    "User-Agent: Mozilla/5.0 (Macintosh; Intel Mac OS X 10_15_7) AppleWebKit/605.1.15 (KHTML, "
+    "like Gecko) Version/18.0 Safari/605.1.15\r\n"
+    "Accept: */*\r\n"
+    "Referer: http://localhost:8080/\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Accept-Language: en-GB,en;q=0.9\r\n"
+    "Cookie: _ga=GA1.1.1234567890.1700000000; session=4f2d8c1a9e7b6d5c3a2f1e0d9c8b7a6f\r\n"
+    "\r\n",
+};
+
+//! @brief Writable copies of the samples, each followed by padding
+struct copies {
+    copies()
+    {
+        for (const auto s : samples) {
+            offs.push_back(buf.size());
+            buf.insert(buf.end(), s.begin(), s.end());
+        }
+        offs.push_back(buf.size());
+        buf.resize(buf.size() + parse_pad);
+    }
+    std::vector<char> buf;
+    std::vector<std::size_t> offs;
+};
+
+//! @brief Parses the samples in turn; parsing is repeatable in place, as it only lowercases
+//! header names and writes sentinels over delimiters
+template <auto Parse>
+std::size_t run(const std::size_t n)
+{
+    static copies c;
+    message msg;
+    std::size_t nbytes = 0;
+    for (auto i = 0_uz; i < n; ++i) {
+        const auto j = i % samples.size();
+        const auto f = c.buf.data() + c.offs[j], l = c.buf.data() + c.offs[j + 1];
+        Parse(f, l - 4, msg);
+        bench::keep(msg.hdrs.get(known_hdr::host).size());
+        nbytes += static_cast<std::size_t>(l - f);
+    }
+    return nbytes;
+}
+} // namespace
+
+//! @brief Request lines of the methods seen in practice
+constexpr std::array<std::string_view, 4> start_lines{
+    "GET /api/search?q=apple&n=50 HTTP/1.1",
+    "GET / HTTP/1.1",
+    "HEAD /index.js HTTP/1.1",
+    "POST /api/vocab HTTP/1.0",
+};
+
+BENCH("message/parse_start")
+{
+    // Each line is terminated as in a request, and padded as the parser may read past its end
+    static auto lines = [] {
+        std::vector<std::vector<char>> r;
+        for (const auto s : start_lines) {
+            r.emplace_back(s.begin(), s.end());
+            r.back().insert(r.back().end(), {'\r', '\n'});
+            r.back().resize(r.back().size() + parse_pad);
+        }
+        return r;
+    }();
+    start st;
+    for (auto i = 0_uz; i < n; ++i) {
+        const auto j = i % lines.size();
+        parse_start(lines[j].data(), lines[j].data() + start_lines[j].size(), st);
+        bench::keep(st.mtd);
+    }
+    return 0;
+}
+
+BENCH("message/parse_header/scalar") { return run<kernels::parse_header_scalar>(n); }
+#ifdef MESSAGE_HAS_SIMD_KERNELS
+BENCH("message/parse_header/sse2") { return run<kernels::parse_header_sse2>(n); }
+#endif
@@ -0,0 +1,45 @@
+#include "bench.h"
+
+#include <array>
+#include <random>
+#include <vector>
+
+#include "../metrics.h"
+#include "../ticks.h"
+
+namespace
+{
+struct alignas(64) request_metrics {
+    std::array<metrics::counter, 64> requests;
+    std::array<metrics::histogram, 4> lat;
+};
+metrics::per_thread<request_metrics> g_m;
+
+//! @brief Durations in ticks spread over a few octaves, as phases of requests are
+const std::vector<uint64_t> &durations()
+{
+    static const auto ds = [] {
+        std::mt19937_64 rng{42};
+        std::lognormal_distribution<double> d{8.0, 1.5};
+        std::vector<uint64_t> r(4096);
+        for (auto &x : r)
+            x = static_cast<uint64_t>(d(rng));
+        return r;
+    }();
+    return ds;
+}
+} // namespace
+
+//! @brief Instrumentation of a request, as the server does it: a counter by route and status, and
+//! the durations of three phases
+BENCH("metrics/request")
+{
+    auto &m        = g_m.local();
+    const auto &ds = durations();
+    for (auto i = 0_uz; i < n; ++i) {
+        m.requests[i % m.requests.size()].add();
+        for (auto p = 0_uz; p < 3; ++p)
+            m.lat[p].add(ticks::to_ns(ds[(i * 3 + p) % ds.size()]));
+    }
+    return 0;
+}
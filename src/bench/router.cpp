@@ -0,0 +1,82 @@
+#include "bench.h"
+
+#include <array>
+#include <random>
+#include <string_view>
+#include <vector>
+
+#include "../router.h"
+
+#include "../lmacro_begin.h"
+
+namespace
+{
+//! @brief Storage of N route-like paths, e.g. "/api/v1/items/0042/details"
+template <std::size_t N>
+constexpr auto path_chars = [] {
+    constexpr std::string_view dirs[]{"/api/v1/", "/static/", "/a/", "/api/v2/users/"};
+    constexpr std::string_view leaves[]{"items", "index.js", "x", "details.css"};
+    std::array<std::array<char, 40>, N> r{};
+    for (auto i = 0_uz; i < N; ++i) {
+        auto it = sr::copy(dirs[i % 4], r[i].begin()).out;
+        it      = sr::copy(leaves[i / 4 % 4], it).out;
+        for (auto j = i; j; j /= 10)
+            *it++ = static_cast<char>('0' + j % 10);
+    }
+    return r;
+}();
+template <std::size_t N>
+constexpr auto paths = [] {
+    std::array<std::string_view, N> r;
+    for (auto i = 0_uz; i < N; ++i)
+        r[i] = path_chars<N>[i].data();
+    return r;
+}();
+
+//! @brief Lookups of every path in random order, with one in eight missing
+template <std::size_t N>
+const std::vector<std::string_view> &queries()
+{
+    static const auto qs = [] {
+        static const std::array<std::string_view, 4> misses{"/api/v1/", "/nope", "/static/items",
+                                                             "/api/v2/users/details.css9999"};
+        std::vector<std::string_view> r;
+        std::mt19937 rng{42};
+        for (auto i = 0_uz; i < 4096; ++i)
+            r.push_back(rng() % 8 ? paths<N>[rng() % N] : misses[rng() % misses.size()]);
+        return r;
+    }();
+    return qs;
+}
+
+template <std::size_t N>
+std::size_t run_phash(const std::size_t n)
+{
+    static constexpr router::phash<N> ph{paths<N>};
+    const auto &qs = queries<N>();
+    for (auto i = 0_uz; i < n; ++i)
+        bench::keep(ph.find(qs[i % qs.size()]));
+    return 0;
+}
+
+template <std::size_t N>
+std::size_t run_linear(const std::size_t n)
+{
+    const auto &qs = queries<N>();
+    for (auto i = 0_uz; i < n; ++i)
+        bench::keep(find_unrl_idx(paths<N>, qs[i % qs.size()]));
+    return 0;
+}
+} // namespace
+
+BENCH("router/linear/4") { return run_linear<4>(n); }
+BENCH("router/linear/16") { return run_linear<16>(n); }
+BENCH("router/linear/64") { return run_linear<64>(n); }
+BENCH("router/linear/256") { return run_linear<256>(n); }
+BENCH("router/phash/4") { return run_phash<4>(n); }
+BENCH("router/phash/16") { return run_phash<16>(n); }
+BENCH("router/phash/64") { return run_phash<64>(n); }
+BENCH("router/phash/256") { return run_phash<256>(n); }
+BENCH("router/phash/1024") { return run_phash<1024>(n); }
+
+#include "../lmacro_end.h"
@@ -0,0 +1,68 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <random>
+#include <string>
+
+#include "../search.h"
+
+namespace
+{
+//! @brief Term column of random lower and upper case words, newline separated
+const std::string &haystack()
+{
+    static const std::string s = [] {
+        constexpr auto sz = 256_uz << 20;
+        std::string r;
+        r.reserve(sz);
+        std::mt19937 rng{42};
+        std::uniform_int_distribution<int> len{3, 14}, ch{0, 2 * 24 - 1};
+        while (r.size() < sz) {
+            for (auto i = len(rng); i--;)
+                if (const auto c = ch(rng); c < 24)
+                    r.push_back(static_cast<char>('a' + c)); // a-x: the needles never match
+                else
+                    r.push_back(static_cast<char>('A' + c - 24));
+            r.push_back('\n');
+        }
+        return r;
+    }();
+    return s;
+}
+
+std::size_t run(const search::kernels::scan_fn k, const std::string_view q, const std::size_t n)
+{
+    const auto &h = haystack();
+    const search::needle nd{q};
+    for (auto i = 0_uz; i < n; ++i)
+        bench::keep(k(h.data(), h.data() + h.size(), nd));
+    return n * h.size();
+}
+
+std::size_t run_std_search(const std::string_view q, const std::size_t n)
+{
+    const auto &h = haystack();
+    for (auto i = 0_uz; i < n; ++i)
+        bench::keep(std::search(h.begin(), h.end(), q.begin(), q.end(), [](char a, char b) {
+            return (to_unsigned(a - 'A') <= 'Z' - 'A' ? a + ('a' - 'A') : a) == b;
+        }));
+    return n * h.size();
+}
+} // namespace
+
+BENCH("search/std::search/1") { return run_std_search("y", n); }
+BENCH("search/std::search/2") { return run_std_search("yz", n); }
+BENCH("search/scalar/1") { return run(search::kernels::scan_scalar, "y", n); }
+BENCH("search/scalar/2") { return run(search::kernels::scan_scalar, "yz", n); }
+#ifdef SEARCH_HAS_SIMD_KERNELS
+BENCH("search/sse2/1") { return run(search::kernels::scan_sse2, "y", n); }
+BENCH("search/sse2/2") { return run(search::kernels::scan_sse2, "yz", n); }
+BENCH("search/avx2/1")
+{
+    return search::kernels::has_avx2() ? run(search::kernels::scan_avx2, "y", n) : 0;
+}
+BENCH("search/avx2/2")
+{
+    return search::kernels::has_avx2() ? run(search::kernels::scan_avx2, "yz", n) : 0;
+}
+#endif
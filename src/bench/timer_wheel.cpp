@@ -0,0 +1,108 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <memory>
+#include <vector>
+
+#include "../timer_wheel.h"
+
+namespace ba = boost::asio;
+
+namespace
+{
+//! @brief Idle connections, as many as a busy server holds
+constexpr auto nconns = 100'000_uz;
+//! @brief Keep-alive timeout in ticks of the wheel, as the server's (5 s in 100 ms ticks)
+constexpr uint64_t timeout = 50;
+//! @brief Requests per tick of the wheel, at which the server sweeps it; every connection makes
+//! one per timeout
+constexpr auto per_tick = nconns / timeout;
+//! @brief Connection making the i-th request: each makes one in every nconns requests, in an order
+//! scattered over memory (7919 being coprime with nconns)
+[[nodiscard]] constexpr std::size_t conn_of(const std::size_t i) noexcept
+{
+    return i * 7919 % nconns;
+}
+
+std::size_t g_fired;
+
+//! @brief Wheel with a timer armed for every connection, due over the span of the timeout
+struct idle_wheel {
+    idle_wheel()
+    {
+        for (auto i = 0_uz; i < nconns; ++i) {
+            es[i].fire = [](timer_wheel::entry &) { ++g_fired; };
+            w.arm(es[i], timeout - i % timeout);
+        }
+    }
+    timer_wheel w{0};
+    std::unique_ptr<timer_wheel::entry[]> es = std::make_unique<timer_wheel::entry[]>(nconns);
+};
+} // namespace
+
+//! @brief Re-arming the idle timer of a connection among 100k as it gets a request, the wheel
+//! being advanced a tick every `per_tick` requests; each timer is re-armed before it comes due, so
+//! none fires
+BENCH("timer_wheel/rearm_100k")
+{
+    // A timer starts out due in the tick after that of its connection's first request
+    static auto &iw = [] -> idle_wheel & {
+        static idle_wheel iw;
+        for (auto i = 0_uz; i < nconns; ++i)
+            iw.w.arm(iw.es[conn_of(i)], i / per_tick + 1);
+        return iw;
+    }();
+    static auto k = 0_uz; // requests so far, over all runs
+    for (auto i = 0_uz; i < n; ++i, ++k) {
+        iw.w.arm(iw.es[conn_of(k)], timeout);
+        if (k % per_tick == per_tick - 1)
+            iw.w.advance(iw.w.now() + 1);
+    }
+    return 0;
+}
+
+//! @brief Arming the idle timers of 100k connections, then advancing the wheel past the timeout
+//! for all of them to fire; per timer
+BENCH("timer_wheel/expire_100k")
+{
+    static idle_wheel iw;
+    for (auto done = 0_uz; done < n;) {
+        const auto k = std::min(n - done, nconns);
+        for (auto i = 0_uz; i < k; ++i)
+            iw.w.arm(iw.es[i], timeout - i % timeout);
+        iw.w.advance(iw.w.now() + timeout + 1);
+        done += k;
+    }
+    bench::keep(g_fired);
+    return 0;
+}
+
+//! @brief For comparison, re-arming a connection's own Asio timer among 100k as the server did
+//! (the pending wait is cancelled and a new one started), the io_context being polled every
+//! `per_tick` requests to run the cancelled waits' handlers
+BENCH("timer_wheel/asio_rearm_100k")
+{
+    struct timers {
+        timers()
+        {
+            ts.reserve(nconns);
+            for (auto i = 0_uz; i < nconns; ++i) {
+                ts.emplace_back(ioc).expires_after(std::chrono::seconds{5});
+                ts.back().async_wait([](auto) {});
+            }
+        }
+        ba::io_context ioc{1};
+        std::vector<ba::steady_timer> ts;
+    };
+    static timers t;
+    for (auto i = 0_uz; i < n; ++i) {
+        auto &tm = t.ts[conn_of(i)];
+        tm.expires_after(std::chrono::seconds{5});
+        tm.async_wait([](auto) {});
+        if (i % per_tick == per_tick - 1)
+            t.ioc.poll();
+    }
+    return 0;
+}
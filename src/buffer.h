@@ -40,7 +40,7 @@ struct buffer {
     JUTIL_INLINE std::size_t put(Args &&...args)
     {
         const auto sz = format::maxsz(args...);
-        Put(
+        Put<Append>(
             sz, [](char *s, auto &&...args) { return format::format(s, args...); }, args...);
         return n_;
     }
@@ -0,0 +1,179 @@
+#include "coding.h"
+
+#include <brotli/encode.h>
+#include <limits.h>
+#include <string.h>
+#include <zlib.h>
+#include <zstd.h>
+
+#include "lmacro_begin.h"
+
+//
+// negotiation
+//
+
+[[nodiscard]] static std::string_view trim(std::string_view sv) noexcept
+{
+    const auto f = sv.find_first_not_of(" \t");
+    if (f == std::string_view::npos)
+        return {};
+    return sv.substr(f, sv.find_last_not_of(" \t") - f + 1);
+}
+
+coding_set accepted_codings(std::string_view ae) noexcept
+{
+    constexpr auto ieq = [](const std::string_view a, const std::string_view b) {
+        return sr::equal(a, b, {}, L(x | 0x20), L(x | 0x20));
+    };
+    constexpr coding_set all = (1u << ncodings) - 1;
+    coding_set listed = 0, acc = 0;
+    bool star = false, star_ok = false;
+    while (!ae.empty()) {
+        const auto comma = ae.find(',');
+        const auto item  = ae.substr(0, comma);
+        ae.remove_prefix(comma == std::string_view::npos ? ae.size() : comma + 1);
+
+        // A q-value of zero ("0", "0.0", ...) makes the coding unacceptable
+        const auto semi = item.find(';');
+        const auto name = trim(item.substr(0, semi));
+        bool ok         = true;
+        if (semi != std::string_view::npos) {
+            const auto prm = trim(item.substr(semi + 1));
+            if (prm.size() >= 3 && (prm[0] | 0x20) == 'q' && prm[1] == '=')
+                ok = prm.substr(2).find_first_not_of("0.") != std::string_view::npos;
+        }
+
+        if (name == "*") {
+            star = true, star_ok = ok;
+            continue;
+        }
+        const auto i = ieq(name, "x-gzip") ? 1_uz : find_if_unrl_idx(coding_names, L(ieq(name, x), &));
+        if (i == ncodings)
+            continue;
+        listed |= 1u << i;
+        acc = ok ? acc | 1u << i : acc & ~(1u << i);
+    }
+    if (star && star_ok)
+        acc |= all & ~listed;
+    if (!(listed & 1u << static_cast<unsigned>(coding::identity)) && !(star && !star_ok))
+        acc |= 1u << static_cast<unsigned>(coding::identity);
+    return acc;
+}
+
+//
+// compression
+//
+
+static bool deflate_gzip(const std::string_view src, std::unique_ptr<char[]> &dst,
+                         std::size_t &ndst)
+{
+    z_stream zs{};
+    if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS, MAX_MEM_LEVEL,
+                     Z_DEFAULT_STRATEGY) != Z_OK)
+        return false;
+    DEFER[&] { deflateEnd(&zs); };
+    const auto cap = deflateBound(&zs, static_cast<uLong>(src.size()));
+    dst            = std::make_unique_for_overwrite<char[]>(cap);
+    zs.next_in     = reinterpret_cast<Bytef *>(const_cast<char *>(src.data()));
+    zs.next_out    = reinterpret_cast<Bytef *>(dst.get());
+    // Fed in chunks, as avail_in and avail_out are only 32-bit
+    for (auto rem = src.size(), orem = static_cast<std::size_t>(cap);;) {
+        zs.avail_in  = static_cast<uInt>(std::min<std::size_t>(rem, UINT_MAX));
+        zs.avail_out = static_cast<uInt>(std::min<std::size_t>(orem, UINT_MAX));
+        rem -= zs.avail_in;
+        orem -= zs.avail_out;
+        const auto r = deflate(&zs, rem ? Z_NO_FLUSH : Z_FINISH);
+        rem += zs.avail_in;
+        orem += zs.avail_out;
+        if (r == Z_STREAM_END)
+            break;
+        if (r != Z_OK && r != Z_BUF_ERROR)
+            return false;
+    }
+    ndst = static_cast<std::size_t>(reinterpret_cast<char *>(zs.next_out) - dst.get());
+    return true;
+}
+
+static bool compress_br(const std::string_view src, std::unique_ptr<char[]> &dst,
+                        std::size_t &ndst)
+{
+    ndst = BrotliEncoderMaxCompressedSize(src.size());
+    if (!ndst)
+        return false;
+    dst = std::make_unique_for_overwrite<char[]>(ndst);
+    return BrotliEncoderCompress(BROTLI_MAX_QUALITY, BROTLI_MAX_WINDOW_BITS, BROTLI_MODE_TEXT,
+                                 src.size(), reinterpret_cast<const uint8_t *>(src.data()), &ndst,
+                                 reinterpret_cast<uint8_t *>(dst.get()));
+}
+
+static bool compress_zstd(const std::string_view src, std::unique_ptr<char[]> &dst,
+                          std::size_t &ndst)
+{
+    const auto cctx = ZSTD_createCCtx();
+    if (!cctx)
+        return false;
+    DEFER[=] { ZSTD_freeCCtx(cctx); };
+    // Decoders of the zstd content-coding may reject windows over 8 MiB (RFC 9659)
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, ZSTD_maxCLevel());
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_windowLog, 23);
+    const auto cap = ZSTD_compressBound(src.size());
+    dst            = std::make_unique_for_overwrite<char[]>(cap);
+    ndst           = ZSTD_compress2(cctx, dst.get(), cap, src.data(), src.size());
+    return !ZSTD_isError(ndst);
+}
+
+bool compress(const coding c, const std::string_view src, std::unique_ptr<char[]> &dst,
+              std::size_t &ndst)
+{
+    switch (c) {
+    case coding::gzip:
+        return deflate_gzip(src, dst, ndst);
+    case coding::br:
+        return compress_br(src, dst, ndst);
+    case coding::zstd:
+        return compress_zstd(src, dst, ndst);
+    default:
+        return false;
+    }
+}
+
+bool gunzip(const char *const src, const std::size_t n, std::unique_ptr<char[]> &dst,
+            std::size_t &ndst)
+{
+    if (n > UINT_MAX)
+        return false;
+
+    // Trailer of the last member has its uncompressed size modulo 2^32
+    uint32_t isz = 0;
+    if (n >= 4)
+        memcpy(&isz, src + n - 4, sizeof(isz));
+    std::size_t cap = std::max<std::size_t>(isz, 4096);
+    dst             = std::make_unique_for_overwrite<char[]>(cap);
+    ndst            = 0;
+
+    z_stream zs{};
+    if (inflateInit2(&zs, 16 + MAX_WBITS) != Z_OK)
+        return false;
+    DEFER[&] { inflateEnd(&zs); };
+    zs.next_in  = reinterpret_cast<Bytef *>(const_cast<char *>(src));
+    zs.avail_in = static_cast<uInt>(n);
+    for (;;) {
+        if (ndst == cap) {
+            auto mem = std::make_unique_for_overwrite<char[]>(cap *= 2);
+            std::copy_n(dst.get(), ndst, mem.get());
+            dst = std::move(mem);
+        }
+        zs.next_out  = reinterpret_cast<Bytef *>(dst.get() + ndst);
+        zs.avail_out = static_cast<uInt>(std::min<std::size_t>(cap - ndst, UINT_MAX));
+        const auto r = inflate(&zs, Z_NO_FLUSH);
+        ndst         = static_cast<std::size_t>(reinterpret_cast<char *>(zs.next_out) - dst.get());
+        if (r == Z_STREAM_END) {
+            if (!zs.avail_in)
+                return true;
+            inflateReset(&zs);
+        } else if (r != Z_OK && !(r == Z_BUF_ERROR && !zs.avail_out))
+            return false;
+    }
+}
+
+#include "lmacro_end.h"
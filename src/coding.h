@@ -0,0 +1,35 @@
+#pragma once
+
+#include <array>
+#include <memory>
+#include <string_view>
+
+#include "jutil.h"
+
+//! @brief Content-codings a representation may be available in; the order is that of the
+//! variants generated by resgen.py
+enum class coding : unsigned char { identity, gzip, br, zstd };
+inline constexpr auto ncodings = 4_uz;
+inline constexpr std::array<std::string_view, ncodings> coding_names{"identity", "gzip", "br",
+                                                                      "zstd"};
+
+//! @brief Set of codings; bit i stands for `coding{i}`
+using coding_set = unsigned;
+
+//! @brief Codings acceptable according to an Accept-Encoding header
+//! @param ae Value of the header; empty if the header is absent
+//!
+//! Codings with a non-zero q-value are equally acceptable, as the smallest of them is served. An
+//! absent header is taken to accept identity only, as is customary, although RFC 9110 permits
+//! any coding then.
+[[nodiscard]] coding_set accepted_codings(std::string_view ae) noexcept;
+
+//! @brief Compresses data at the coding's maximum level
+//! @param c Coding to compress with; not identity
+//! @param dst Set to the compressed data
+//! @param ndst Set to the size of the compressed data
+//! @return Whether compression succeeded
+bool compress(coding c, std::string_view src, std::unique_ptr<char[]> &dst, std::size_t &ndst);
+
+//! @brief Decompresses gzip data (of possibly many members)
+bool gunzip(const char *src, std::size_t n, std::unique_ptr<char[]> &dst, std::size_t &ndst);
@@ -1,8 +1,10 @@
 #pragma once
 
+#include <algorithm>
 #include <chrono>
 #include <concepts>
 #include <string.h>
+#include <string_view>
 
 #include "jutil.h"
 
@@ -115,6 +117,16 @@ struct format_impl {
 
     static const char radix_100_table[200];
     static char *itoa(const uint32_t x, char *d_f) noexcept;
+    //! @brief Formats a value that doesn't fit in 32 bits, as groups of 9 digits
+    static JUTIL_NOINLINE char *itoa64(const uint64_t x, char *d_f) noexcept
+    {
+        constexpr uint64_t e9 = 1'000'000'000;
+        const auto hi         = x / e9;
+        d_f = hi > UINT32_MAX ? format_impl::format(d_f, static_cast<uint32_t>(hi / e9),
+                                                    fmt_width<9>(static_cast<uint32_t>(hi % e9)))
+                              : itoa(static_cast<uint32_t>(hi), d_f);
+        return format_impl::format(d_f, fmt_width<9>(static_cast<uint32_t>(x % e9)));
+    }
 
     template <std::integral T, class... Rest>
     static JUTIL_INLINE char *format(char *d_f, T x, Rest &&...rest) noexcept
@@ -125,6 +137,10 @@ struct format_impl {
                 *d_f++ = '-';
             }
         }
+        if constexpr (sizeof(T) > sizeof(uint32_t))
+            if (static_cast<uint64_t>(x) > UINT32_MAX) [[unlikely]]
+                return format_impl::format(format_impl::itoa64(static_cast<uint64_t>(x), d_f),
+                                           static_cast<Rest &&>(rest)...);
         return format_impl::format(format_impl::itoa(static_cast<uint32_t>(x), d_f),
                                    static_cast<Rest &&>(rest)...);
     }
@@ -229,7 +245,8 @@ struct maxsz_impl {
     template <std::integral T, class... Rest>
     static constexpr JUTIL_INLINE std::size_t maxsz(T, Rest &&...rest) noexcept
     {
-        return 10 + std::is_signed_v<T> + maxsz_impl::maxsz(static_cast<Rest &&>(rest)...);
+        return (sizeof(T) > sizeof(uint32_t) ? 20 : 10) + std::is_signed_v<T> +
+               maxsz_impl::maxsz(static_cast<Rest &&>(rest)...);
     }
 
     template <std::size_t N, class T, class... Rest>
@@ -272,4 +289,47 @@ concept formatable = requires(char *d_f, const T &x) {
     detail::format_impl::format(d_f, x);
 };
 // clang-format on
+
+//
+// html escaping
+//
+
+//! @brief Text to be formatted with `<`, `>` and `&` escaped, as in HTML content
+struct escaped {
+    escaped(const std::string_view sv) : f{sv.data()}, l{sv.data() + sv.size()} {}
+    constexpr JUTIL_INLINE std::size_t size() const noexcept
+    {
+        return static_cast<std::size_t>(l - f);
+    }
+    const char *const f, *const l;
+};
+
+template <class It>
+It escape(const char *f, const char *const l, It d_f) noexcept
+{
+#define ESC_copystr(S) std::copy_n(S, sizeof(S) - 1, d_f)
+    for (; f != l; ++f) {
+        switch (const char c = *f) {
+        case '<':
+            d_f = ESC_copystr("&lt;");
+            break;
+        case '>':
+            d_f = ESC_copystr("&gt;");
+            break;
+        case '&':
+            d_f = ESC_copystr("&amp;");
+            break;
+        default:
+            *d_f++ = c;
+        }
+    }
+    return d_f;
+#undef ESC_copystr
+}
+
+template <>
+struct formatter<escaped> {
+    static char *format(char *d_f, const escaped &e) noexcept { return escape(e.f, e.l, d_f); }
+    static std::size_t maxsz(const escaped &e) noexcept { return e.size() * 5; }
+};
 } // namespace format
\ No newline at end of file
@@ -4,6 +4,8 @@
 #include <array>
 #include <cassert>
 #include <concepts>
+#include <limits>
+#include <memory>
 #include <ranges>
 #include <span>
 #include <type_traits>
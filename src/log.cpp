@@ -0,0 +1,191 @@
+#include "log.h"
+
+#include <charconv>
+#include <chrono>
+#include <errno.h>
+#include <filesystem>
+#include <limits.h>
+#ifdef __linux__
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#include "format.h"
+
+#include "lmacro_begin.h"
+
+namespace sc = std::chrono;
+namespace sf = std::filesystem;
+
+detail::log::~log()
+{
+    if (writer.joinable()) {
+        writer.request_stop();
+        writer.join();
+    } else if (fmt == log_format::text)
+        drain();
+    if (file != stdout)
+        fclose(file);
+}
+
+bool detail::log::init()
+{
+    if (fmt != log_format::text)
+        return false;
+    start();
+    return true;
+}
+
+bool detail::log::init(const char *const dir_)
+{
+    dir = dir_;
+    if (!open_next())
+        return false;
+    start();
+    return true;
+}
+
+void detail::log::start()
+{
+    writer = std::jthread{[this](const std::stop_token st) {
+        for (;;) {
+            // A final pass is made after the stop request
+            const auto stop = st.stop_requested();
+            if (!drain()) {
+                if (stop)
+                    break;
+                std::this_thread::sleep_for(sc::milliseconds{20});
+            }
+        }
+    }};
+}
+
+bool detail::log::open_next()
+{
+    // Numbered past the highest number in the directory, so that deleting old files doesn't lead
+    // to overwriting newer ones; a number taken meanwhile (e.g. by another log there) is skipped
+    std::size_t id = 0;
+    std::error_code ec;
+    for (const auto &e : sf::directory_iterator{dir, ec}) {
+        const auto stem = e.path().stem().string();
+        std::size_t n;
+        if (const auto [p, err] = std::from_chars(stem.data(), stem.data() + stem.size(), n);
+            err == std::errc{} && p == stem.data() + stem.size())
+            id = std::max(id, n + 1);
+    }
+    FILE *f;
+    for (;; ++id) {
+        const auto path =
+            (sf::path{dir} / std::to_string(id)).concat(fmt == log_format::text ? ".log" : ".alog");
+        if ((f = fopen(path.string().c_str(), fmt == log_format::text ? "wx" : "wbx")))
+            break;
+        if (errno != EEXIST)
+            return false;
+    }
+    if (file != stdout)
+        fclose(file);
+    file = f;
+    // Copied, lest a thread appending to the header wait for the write
+    thread_local std::string hdr;
+    {
+        std::scoped_lock lk{mtx};
+        hdr = header;
+    }
+    nfile = fwrite(hdr.data(), sizeof(char), hdr.size(), file);
+    fflush(file);
+    return true;
+}
+
+void detail::log::append_header(const void *const p, const std::size_t n)
+{
+    std::scoped_lock lk{mtx};
+    header.append(static_cast<const char *>(p), n);
+}
+
+detail::log::ring &detail::log::attach(local_rings &t)
+{
+    std::scoped_lock lk{mtx};
+    const auto id = std::this_thread::get_id();
+    auto it = sr::find(rings, id, L(x->producer));
+    if (it == rings.end()) {
+        rings.push_back(std::make_unique<ring>());
+        it            = rings.end() - 1;
+        (*it)->producer = id;
+    }
+    // Cached in a free slot, or in place of the last one
+    const auto slot = sr::find(t, nullptr, L(x.first));
+    *(slot == t.end() ? t.end() - 1 : slot) = {this, it->get()};
+    return **it;
+}
+
+bool detail::log::drain()
+{
+    struct piece {
+        const char *p;
+        std::size_t n;
+    };
+    thread_local std::vector<piece> pcs;
+    thread_local std::vector<std::pair<ring *, uint64_t>> ends;
+    pcs.clear();
+    ends.clear();
+    {
+        std::scoped_lock lk{mtx};
+        for (const auto &r : rings) {
+            const auto t = r->tail.load(std::memory_order_relaxed);
+            const auto h = r->head.load(std::memory_order_acquire);
+            if (h == t)
+                continue;
+            const auto i = static_cast<std::size_t>(t & (ring_cap - 1));
+            const auto n = static_cast<std::size_t>(h - t);
+            const auto k = std::min(n, ring_cap - i);
+            pcs.push_back({&r->data[i], k});
+            if (n != k)
+                pcs.push_back({&r->data[0], n - k});
+            ends.emplace_back(r.get(), h);
+        }
+    }
+    char note[64];
+    if (const auto d = dropped(); fmt == log_format::text && d != reported) {
+        const auto l = format::format(note, "log: dropped ", d - reported, " lines\n");
+        pcs.push_back({note, static_cast<std::size_t>(l - note)});
+        reported = d;
+    }
+    if (pcs.empty())
+        return false;
+
+    // Written out whole (or not at all on error), lest lines of different threads interleave
+#ifdef __linux__
+    thread_local std::vector<iovec> iov;
+    iov.clear();
+    for (const auto &[p, n] : pcs)
+        iov.push_back({const_cast<char *>(p), n});
+    for (auto it = iov.begin(); it != iov.end();) {
+        const auto cnt = std::min<std::ptrdiff_t>(iov.end() - it, IOV_MAX);
+        auto w         = writev(fileno(file), &*it, static_cast<int>(cnt));
+        if (w < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        nfile += static_cast<std::size_t>(w);
+        for (; it != iov.end() && static_cast<std::size_t>(w) >= it->iov_len; ++it)
+            w -= static_cast<ssize_t>(it->iov_len);
+        if (it != iov.end()) {
+            it->iov_base = static_cast<char *>(it->iov_base) + w;
+            it->iov_len -= static_cast<std::size_t>(w);
+        }
+    }
+#else
+    for (const auto &[p, n] : pcs)
+        nfile += fwrite(p, sizeof(char), n, file);
+    fflush(file);
+#endif
+    for (const auto &[r, h] : ends)
+        r->tail.store(h, std::memory_order_release);
+
+    if (!dir.empty() && nfile >= rotate_size && !open_next())
+        nfile = 0; // keep the current file
+    return true;
+}
+
+#include "lmacro_end.h"
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "buffer.h"
+#include "jutil.h"
+
+namespace detail
+{
+enum class log_format {
+    text,   // lines, written to <n>.log
+    binary, // records, written to <n>.alog after `header`
+};
+
+//! @brief Shared by all workers; lines are written by a background thread
+//!
+//! Every thread formats its lines into a lock-free ring of its own, which the background thread
+//! drains in batches, with a single `writev` for all the rings. A line that doesn't fit in the
+//! ring is dropped (and counted) rather than waited for, so that a slow disk can't stall serving.
+//! Lines printed before `init` are written once it's called.
+//!
+//! A binary log takes records through `push` instead, and begins every file with `header`.
+struct log {
+    static constexpr auto ring_cap    = 64_uz << 10; // per thread; a power of two
+    static constexpr auto rotate_size = 64_uz << 20; // of a file in the log directory
+
+    explicit log(const log_format fmt = log_format::text) : fmt{fmt} {}
+    ~log();
+    NO_COPY_MOVE(log);
+
+    //! @brief Starts logging to stdout
+    bool init();
+    //! @brief Starts logging to files in given directory, a new one every `rotate_size` bytes
+    bool init(const char *dir);
+
+    template <class... Args>
+    JUTIL_INLINE void print(Args &&...args) noexcept
+    {
+        auto &buf      = line_buf();
+        const auto len = buf.put(static_cast<Args &&>(args)..., "\n");
+        push(buf.data(), len);
+    }
+
+    //! @brief Queues n bytes at p, all or nothing
+    //! @return Whether they were queued rather than dropped
+    JUTIL_INLINE bool push(const void *const p, const std::size_t n) noexcept
+    {
+        if (local().push(static_cast<const char *>(p), n)) [[likely]]
+            return true;
+        drops.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    //! @brief Number of lines (or pushes) dropped so far
+    [[nodiscard]] JUTIL_INLINE uint64_t dropped() const noexcept
+    {
+        return drops.load(std::memory_order_relaxed);
+    }
+    [[nodiscard]] JUTIL_INLINE bool running() const noexcept { return writer.joinable(); }
+
+    //! @brief Appends n bytes at p to `header`, for every file started from now on to begin with
+    void append_header(const void *p, std::size_t n);
+
+    std::string header; // set before `init`; then changed only through `append_header`
+
+  private:
+    //! @brief Single-producer single-consumer queue of bytes
+    struct ring {
+        JUTIL_INLINE bool push(const char *const p, const std::size_t n) noexcept
+        {
+            const auto h = head.load(std::memory_order_relaxed);
+            if (n > ring_cap - (h - tail.load(std::memory_order_acquire)))
+                return false;
+            const auto i = static_cast<std::size_t>(h & (ring_cap - 1));
+            const auto k = std::min(n, ring_cap - i);
+            memcpy(&data[i], p, k);
+            memcpy(&data[0], p + k, n - k);
+            head.store(h + n, std::memory_order_release);
+            return true;
+        }
+        std::thread::id producer;
+        alignas(64) std::atomic<uint64_t> head{0}; // bytes pushed
+        alignas(64) std::atomic<uint64_t> tail{0}; // bytes written out
+        alignas(64) char data[ring_cap];
+    };
+    using local_rings = std::array<std::pair<const log *, ring *>, 2>;
+
+    [[nodiscard]] static JUTIL_INLINE buffer &line_buf()
+    {
+        thread_local buffer buf;
+        return buf;
+    }
+    [[nodiscard]] JUTIL_INLINE ring &local()
+    {
+        thread_local local_rings t{};
+        for (const auto &[o, r] : t)
+            if (o == this) [[likely]]
+                return *r;
+        return attach(t);
+    }
+    ring &attach(local_rings &t);
+    void start();
+    bool open_next();
+    //! @brief Writes out what the rings hold
+    //! @return Whether there was anything to write
+    bool drain();
+
+    const log_format fmt;
+    std::mutex mtx; // guards `rings` and, once running, `header`
+    std::vector<std::unique_ptr<ring>> rings;
+    std::atomic<uint64_t> drops{0};
+    uint64_t reported = 0; // drops written out as a line
+    std::string dir;       // empty if logging to stdout
+    FILE *file = stdout;
+    std::size_t nfile = 0; // bytes written to `file`
+    std::jthread writer;   // last, to stop before the rest is destroyed
+};
+} // namespace detail
@@ -1,7 +1,12 @@
 #include "message.h"
 
+#include <bit>
+#include <charconv>
 #include <magic_enum.hpp>
 #include <string.h>
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
 
 #include "lmacro_begin.h"
 
@@ -11,31 +16,16 @@ void headers::grow()
 {
     const auto new_cap = cap_ * 2;
     auto new_mem       = std::make_unique_for_overwrite<entry[]>(new_cap);
-    std::copy_n(buf_.get(), n_, new_mem.get());
-    buf_.reset(new_mem.release());
-    cap_ = new_cap;
-}
-
-void headers::reserve(char *const kf, char *const kl, char *const vf, char *const vl)
-{
-    if (n_ == cap_) [[unlikely]]
-        grow();
-    const auto f = begin();
-    const auto l = end();
-    l->first.n   = 0;
-    const string k{kf, static_cast<std::size_t>(kl - kf)};
-    const auto lb = find_if_always_idx(f, l + 1, L(!(k < x.first), k));
-    memmove(&f[lb + 1], &f[lb], sizeof(entry) * (n_ - lb));
-    ++n_;
-    f[lb] = {k, {vf, static_cast<std::size_t>(vl - vf)}};
+    std::copy_n(data(), n_, new_mem.get());
+    heap_ = std::move(new_mem);
+    cap_  = new_cap;
 }
 
 //
 // parse_header
 //
 
-constexpr auto lccnv = L(to_unsigned(x - 'A') <= to_unsigned('Z' - 'A') ? x + ('a' - 'A') : x);
-void parse_header(char *f, char *const l, message &msg)
+void kernels::parse_header_scalar(char *f, char *const l, message &msg)
 {
     auto i = std::find(f, l, '\r');
     parse_start(f, i, msg.strt);
@@ -46,10 +36,91 @@ void parse_header(char *f, char *const l, message &msg)
         const auto colon = transform_always_until(f, l + 2, f, L(static_cast<char>(lccnv(x))), ':');
         const auto val   = find_if_always(colon + 1, l + 2, L(!(phdrws(x))));
         i                = find_always(val, l + 3, '\r');
-        msg.hdrs.reserve(f, colon, val, i);
+        msg.hdrs.add(f, colon, val, i);
+    }
+}
+
+#ifdef MESSAGE_HAS_SIMD_KERNELS
+//! @brief Finds the first c at or after p, 16 bytes at a time; c must occur before the padding
+//! of the buffer ends
+[[nodiscard]] static JUTIL_INLINE char *find_sse2(char *p, const char c) noexcept
+{
+    const auto vc = _mm_set1_epi8(c);
+    for (;; p += 16) {
+        const auto x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        if (const auto m = _mm_movemask_epi8(_mm_cmpeq_epi8(x, vc)))
+            return p + std::countr_zero(static_cast<unsigned>(m));
+    }
+}
+
+//! @brief Lowercases ASCII letters up to the first colon, 16 bytes at a time; bytes past the
+//! colon are left as they were
+//! @return Pointer to the colon
+[[nodiscard]] static JUTIL_INLINE char *lower_until_colon_sse2(char *p) noexcept
+{
+    const auto colon = _mm_set1_epi8(':');
+    const auto bias  = _mm_set1_epi8(static_cast<char>(0x80 - 'A')); // A-Z to the 26 least
+    const auto lim   = _mm_set1_epi8(static_cast<char>(-128 + 26));
+    const auto bit   = _mm_set1_epi8(0x20);
+    const auto iota  = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    for (;; p += 16) {
+        const auto x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        auto up      = _mm_cmplt_epi8(_mm_add_epi8(x, bias), lim);
+        const auto m = _mm_movemask_epi8(_mm_cmpeq_epi8(x, colon));
+        if (m) {
+            const auto n = std::countr_zero(static_cast<unsigned>(m));
+            up = _mm_and_si128(up, _mm_cmplt_epi8(iota, _mm_set1_epi8(static_cast<char>(n))));
+            if (_mm_movemask_epi8(up))
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(p),
+                                 _mm_or_si128(x, _mm_and_si128(up, bit)));
+            return p + n;
+        }
+        if (_mm_movemask_epi8(up))
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(p), _mm_or_si128(x, _mm_and_si128(up, bit)));
     }
 }
 
+void kernels::parse_header_sse2(char *f, char *const l, message &msg)
+{
+    auto i = find_sse2(f, '\r');
+    parse_start(f, i, msg.strt);
+    msg.hdrs.clear();
+    l[1] = ':'; // sentinel
+    while (reinterpret_cast<uintptr_t>(i) < reinterpret_cast<uintptr_t>(l)) {
+        f                = i + 2;
+        const auto colon = lower_until_colon_sse2(f);
+        auto val         = colon + 1;
+        while (phdrws(*val))
+            ++val;
+        i = find_sse2(val, '\r');
+        msg.hdrs.add(f, colon, val, i);
+    }
+}
+#endif
+
+void parse_header(char *f, char *const l, message &msg)
+{
+#ifdef MESSAGE_HAS_SIMD_KERNELS
+    kernels::parse_header_sse2(f, l, msg);
+#else
+    kernels::parse_header_scalar(f, l, msg);
+#endif
+}
+
+//
+// rbuf
+//
+
+void rbuf::grow(const std::size_t n)
+{
+    const auto new_cap = std::max(cap_ * 2, n);
+    auto new_mem       = std::make_unique<char[]>(new_cap + parse_pad);
+    std::copy_n(buf_, n_, new_mem.get());
+    own_ = std::move(new_mem);
+    buf_ = own_.get();
+    cap_ = new_cap;
+}
+
 //
 // print_header
 //
@@ -61,6 +132,12 @@ void print_header(const message &msg)
     printf("METHOD: %.*s\nTARGET: %.*s\nVERSION: %.*s\n", static_cast<int>(mtds.size()),
            mtds.data(), static_cast<int>(msg.strt.tgt.n), msg.strt.tgt.p,
            static_cast<int>(ver.size()), ver.data());
+    for (auto i = 0_uz; i < headers::nknown; ++i)
+        if (const auto h = static_cast<known_hdr>(i); msg.hdrs.has(h)) {
+            const auto v = msg.hdrs.get(h);
+            printf("  %.*s: %.*s\n", static_cast<int>(known_hdr_names[i].size()),
+                   known_hdr_names[i].data(), static_cast<int>(v.size()), v.data());
+        }
     for (const auto [a, b] : msg.hdrs)
         printf("  %.*s: %.*s\n", static_cast<int>(a.n), a.p, static_cast<int>(b.n), b.p);
 }
@@ -109,3 +186,141 @@ void parse_start(char *const f, char *const l, start &s) noexcept
     else [[unlikely]]
         s.ver = version::err;
 }
+
+//
+// request_parser
+//
+
+[[nodiscard]] static std::string_view trim(std::string_view sv) noexcept
+{
+    const auto f = sv.find_first_not_of(" \t");
+    if (f == std::string_view::npos)
+        return {};
+    return sv.substr(f, sv.find_last_not_of(" \t") - f + 1);
+}
+
+std::size_t request_parser::line_end(const char *const f, const std::size_t n) noexcept
+{
+    const auto s = std::max(scan_, pos_);
+    const auto i = std::string_view{f + s, n - s}.find('\n');
+    scan_        = (i == std::string_view::npos) ? n : s + i + 1;
+    return (i == std::string_view::npos) ? i : s + i;
+}
+
+request_parser::result request_parser::start_body(const message &msg) noexcept
+{
+    // Requests with more than one length are rejected, as they may be read differently by
+    // intermediaries: https://www.rfc-editor.org/rfc/rfc9112#section-6.3
+    const auto &hs = msg.hdrs;
+    if (sr::any_of(hs, L(x.first == "content-length" || x.first == "transfer-encoding")))
+        return result::bad;
+    if (hs.has(known_hdr::transfer_encoding)) {
+        const auto te = trim(hs.get(known_hdr::transfer_encoding));
+        if (hs.has(known_hdr::content_length) ||
+            !sr::equal(te, std::string_view{"chunked"}, {}, L(x | 0x20)))
+            return result::bad;
+        st_ = state::chunk_size;
+    } else if (hs.has(known_hdr::content_length)) {
+        const auto cl = trim(hs.get(known_hdr::content_length));
+        uint64_t n    = 0;
+        const auto [p, ec] = std::from_chars(cl.data(), cl.data() + cl.size(), n);
+        if (cl.empty() || cl[0] == '-' || p != cl.data() + cl.size())
+            return ec == std::errc::result_out_of_range ? result::too_large : result::bad;
+        if (n > max_body)
+            return result::too_large;
+        rem_ = static_cast<std::size_t>(n);
+        st_  = state::length;
+    } else
+        st_ = state::done;
+    return result::complete;
+}
+
+request_parser::result request_parser::parse(char *const f, char *const l, message &msg)
+{
+    static constexpr std::string_view crlf2 = "\r\n\r\n";
+    constexpr auto npos = std::string_view::npos;
+    const auto n        = static_cast<std::size_t>(l - f);
+    for (;;)
+        switch (st_) {
+        case state::header: {
+            // Only the first max_header bytes are searched, so that a header never ending can't
+            // keep the buffer growing
+            const auto e = std::min(n, max_header);
+            const auto s = scan_ < 3 ? 0 : scan_ - 3;
+            const auto i = std::string_view{f + s, e - s}.find(crlf2);
+            if (i == npos) {
+                scan_ = e;
+                return n > max_header ? result::header_too_large : result::incomplete;
+            }
+            hdr_ = pos_ = s + i + crlf2.size();
+            parse_header(f, f + (hdr_ - 4), msg);
+            base_ = f;
+            if (const auto r = start_body(msg); r != result::complete)
+                return r;
+            break;
+        }
+        case state::length: {
+            const auto k = std::min(rem_, n - pos_);
+            pos_ += k, body_ += k, rem_ -= k;
+            if (rem_)
+                return result::incomplete;
+            st_ = state::done;
+            break;
+        }
+        case state::chunk_size: {
+            // chunk-size [ chunk-ext ] CRLF, the extensions being ignored
+            const auto e = line_end(f, n);
+            if (e == npos)
+                return (n - pos_ > max_line) ? result::bad : result::incomplete;
+            uint64_t sz        = 0;
+            const auto [p, ec] = std::from_chars(f + pos_, f + e, sz, 16);
+            if (p == f + pos_ || (*p != '\r' && *p != ';' && !phdrws(*p)))
+                return ec == std::errc::result_out_of_range ? result::too_large : result::bad;
+            if (sz > max_body - body_)
+                return result::too_large;
+            pos_ = e + 1;
+            rem_ = static_cast<std::size_t>(sz);
+            st_  = sz ? state::chunk_data : state::trailer;
+            break;
+        }
+        case state::chunk_data: {
+            // Moved next to the body decoded so far, over the framing already consumed
+            const auto k = std::min(rem_, n - pos_);
+            memmove(f + hdr_ + body_, f + pos_, k);
+            pos_ += k, body_ += k, rem_ -= k;
+            if (rem_)
+                return result::incomplete;
+            st_ = state::chunk_end;
+            break;
+        }
+        case state::chunk_end:
+            if (n - pos_ < 2)
+                return result::incomplete;
+            if (f[pos_] != '\r' || f[pos_ + 1] != '\n')
+                return result::bad;
+            pos_ += 2;
+            st_ = state::chunk_size;
+            break;
+        case state::trailer: {
+            // Trailer fields are skipped up to the empty line ending the message
+            const auto e = line_end(f, n);
+            if (e == npos)
+                return (n - pos_ > max_line) ? result::bad : result::incomplete;
+            const auto empty = e == pos_ || (e == pos_ + 1 && f[pos_] == '\r');
+            pos_             = e + 1;
+            if (empty)
+                st_ = state::done;
+            break;
+        }
+        case state::done:
+            // The header is parsed again if the bytes have moved since
+            if (f != base_) {
+                parse_header(f, f + (hdr_ - 4), msg);
+                base_ = f;
+            }
+            msg.body = {f + hdr_, body_};
+            return result::complete;
+        }
+}
+
+#include "lmacro_end.h"
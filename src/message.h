@@ -1,11 +1,16 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <limits>
 #include <memory>
+#include <span>
 #include <stdexcept>
+#include <string.h>
 #include <string_view>
 
 #include "jutil.h"
+#include "router.h"
 
 #include "lmacro_begin.h"
 
@@ -58,68 +63,200 @@ void parse_start(char *const f, char *const l, start &s) noexcept;
 // HEADERS
 //
 
+//! @brief Lowercases an ASCII letter
+inline constexpr auto lccnv =
+    L(to_unsigned(x - 'A') <= to_unsigned('Z' - 'A') ? x + ('a' - 'A') : x);
+
+//! @brief Headers the server looks up; each has a slot of its own in `headers`
+enum class known_hdr : unsigned char {
+    host,
+    accept_encoding,
+    if_none_match,
+    range,
+    connection,
+    content_length,
+    transfer_encoding
+};
+inline constexpr std::array<std::string_view, 7> known_hdr_names{
+    "host",       "accept-encoding", "if-none-match",    "range",
+    "connection", "content-length",  "transfer-encoding"};
+
+//! @brief Header fields of a message; names are lowercase
+//!
+//! Known headers are put in their slots through a perfect hash, so getting one is O(1). Others
+//! are kept in order of arrival in an inline small vector, which only allocates past
+//! `inline_cap` of them. A repeated known header is kept with the others, as only the first one
+//! has a slot.
 struct headers {
     struct entry {
         string first, second;
     };
-    static constexpr auto defcap = 64_uz;
+    static constexpr auto nknown     = known_hdr_names.size();
+    static constexpr auto inline_cap = 32_uz;
+    static constexpr router::phash<nknown> known_hash{known_hdr_names};
 
     //
-    // SPAN
+    // SPAN (of the headers that aren't known)
     //
-    [[nodiscard]] JUTIL_INLINE const entry *begin() const noexcept { return buf_.get(); }
-    [[nodiscard]] JUTIL_INLINE const entry *end() const noexcept { return buf_.get() + n_; }
-    [[nodiscard]] JUTIL_INLINE entry *begin() noexcept { return buf_.get(); }
-    [[nodiscard]] JUTIL_INLINE entry *end() noexcept { return buf_.get() + n_; }
+    [[nodiscard]] JUTIL_INLINE const entry *begin() const noexcept { return data(); }
+    [[nodiscard]] JUTIL_INLINE const entry *end() const noexcept { return data() + n_; }
+    [[nodiscard]] JUTIL_INLINE entry *begin() noexcept { return data(); }
+    [[nodiscard]] JUTIL_INLINE entry *end() noexcept { return data() + n_; }
 
     //
     // MODIFICATION
     //
-    constexpr JUTIL_INLINE void clear() noexcept { n_ = 0; }
+    JUTIL_INLINE void clear() noexcept
+    {
+        known_.fill({});
+        n_ = 0;
+    }
     void grow();
-    void reserve(char *const kf, char *const kl, char *const vf, char *const vl);
+    //! @brief Adds a header whose name [kf:kl) is lowercase and whose value is [vf:vl)
+    JUTIL_INLINE void add(char *const kf, char *const kl, char *const vf, char *const vl)
+    {
+        const string k{kf, static_cast<std::size_t>(kl - kf)};
+        const string v{vf, static_cast<std::size_t>(vl - vf)};
+        if (const auto i = known_hash.find(k); i != nknown && !known_[i].p) {
+            known_[i] = v;
+            return;
+        }
+        if (n_ == cap_) [[unlikely]]
+            grow();
+        data()[n_++] = {k, v};
+    }
 
     //
     // KEY GET
     //
-    [[nodiscard]] JUTIL_INLINE std::string_view get(const std::string_view keyuc) const
+    [[nodiscard]] JUTIL_INLINE bool has(const known_hdr h) const noexcept
+    {
+        return known_[static_cast<std::size_t>(h)].p;
+    }
+    //! @return Value of given header, or def if there is none
+    [[nodiscard]] JUTIL_INLINE std::string_view get(const known_hdr h,
+                                                    const std::string_view def = {}) const noexcept
     {
-        const auto it = sr::find(begin(), end(), keyuc, L(std::string_view(x.first.p, x.first.n)));
-        return (it == end()) ? throw std::out_of_range{"headers::get"} : it->second;
+        const auto &v = known_[static_cast<std::size_t>(h)];
+        return v.p ? v.sv() : def;
     }
-    [[nodiscard]] JUTIL_INLINE std::string_view get(const std::string_view keyuc,
+    //! @param key Lowercase name of the header
+    [[nodiscard]] JUTIL_INLINE std::string_view get(const std::string_view key) const
+    {
+        const auto v = find(key);
+        return v ? v->sv() : throw std::out_of_range{"headers::get"};
+    }
+    //! @param key Lowercase name of the header
+    [[nodiscard]] JUTIL_INLINE std::string_view get(const std::string_view key,
                                                     const std::string_view def) const noexcept
     {
-        const auto it = sr::find(begin(), end(), keyuc, L(std::string_view(x.first.p, x.first.n)));
-        return (it == end()) ? def : it->second;
+        const auto v = find(key);
+        return v ? v->sv() : def;
     }
+    //! @param key Name of the header in any case
     template <std::size_t N>
     [[nodiscard]] JUTIL_INLINE std::string_view get(const char (&key)[N]) const
     {
-        char uc[N - 1];
-        std::transform(key, key + (N - 1), uc, FREF(toupper));
-        return get(uc);
+        char lc[N - 1];
+        std::transform(key, key + (N - 1), lc, L(static_cast<char>(lccnv(x))));
+        return get(std::string_view{lc, N - 1});
     }
+    //! @param key Name of the header in any case
     template <std::size_t N>
     [[nodiscard]] JUTIL_INLINE std::string_view get(const char (&key)[N],
                                                     const std::string_view def) const noexcept
     {
-        char uc[N - 1];
-        std::transform(key, key + (N - 1), uc, FREF(toupper));
-        return get(uc, def);
+        char lc[N - 1];
+        std::transform(key, key + (N - 1), lc, L(static_cast<char>(lccnv(x))));
+        return get(std::string_view{lc, N - 1}, def);
     }
 
-    std::unique_ptr<entry[]> buf_ = std::make_unique_for_overwrite<entry[]>(defcap);
-    std::size_t n_ = 0_uz, cap_ = defcap;
+    std::array<string, nknown> known_{}; // {nullptr, 0} if absent
+    std::array<entry, inline_cap> inline_;
+    std::unique_ptr<entry[]> heap_; // set once there are more than inline_cap others
+    std::size_t n_ = 0_uz, cap_ = inline_cap;
+
+  private:
+    [[nodiscard]] JUTIL_INLINE entry *data() noexcept { return heap_ ? heap_.get() : inline_.data(); }
+    [[nodiscard]] JUTIL_INLINE const entry *data() const noexcept
+    {
+        return heap_ ? heap_.get() : inline_.data();
+    }
+    [[nodiscard]] JUTIL_INLINE const string *find(const std::string_view key) const noexcept
+    {
+        if (const auto i = known_hash.find(key); i != nknown)
+            return known_[i].p ? &known_[i] : nullptr;
+        const auto it = sr::find(begin(), end(), key, L(x.first.sv()));
+        return it == end() ? nullptr : &it->second;
+    }
 };
 
+//! @brief Number of bytes past the end of a message header that parsing may read
+inline constexpr auto parse_pad = 32_uz;
+
 //! @brief Parses given HTTP message header; [f:l) must be writable; l must point to CRLFCR and be writable
 //! @param f Pointer to the beginning of the message
-//! @param l Pointer to the end of the message
+//! @param l Pointer to the end of the message; followed by at least `parse_pad` readable bytes
 //! @param msg Object to represent parsed message
+//!
+//! Delimiters are searched for and header names lowercased 16 bytes at a time where supported.
 void parse_header(char *f, char *const l, struct message &msg);
 void print_header(const struct message &msg);
 
+namespace kernels
+{
+void parse_header_scalar(char *f, char *const l, struct message &msg);
+#if defined(__x86_64__) || defined(_M_X64)
+#define MESSAGE_HAS_SIMD_KERNELS 1
+void parse_header_sse2(char *f, char *const l, struct message &msg);
+#endif
+} // namespace kernels
+
+//
+// READ BUFFER
+//
+
+//! @brief Bytes received on a connection; the data is always followed by `parse_pad` readable
+//! bytes, so that parsing never reads out of bounds
+//!
+//! The buffer starts out in memory given to it (e.g. by a `read_pool`), or on the heap; it moves
+//! to the heap once it outgrows the former.
+struct rbuf {
+    static constexpr auto defcap = 4096_uz;
+
+    rbuf() : own_{std::make_unique<char[]>(defcap + parse_pad)}, buf_{own_.get()} {}
+    //! @param mem Memory to start out in, including the padding; outlives the buffer
+    explicit rbuf(const std::span<char> mem) noexcept
+        : buf_{mem.data()}, cap_{mem.size() - parse_pad}
+    {
+    }
+
+    [[nodiscard]] JUTIL_INLINE char *data() noexcept { return buf_; }
+    [[nodiscard]] JUTIL_INLINE std::size_t size() const noexcept { return n_; }
+
+    //! @brief Space for at least n bytes past the data; `commit` makes them part of it
+    [[nodiscard]] JUTIL_INLINE std::span<char> prepare(const std::size_t n)
+    {
+        if (cap_ - n_ < n) [[unlikely]]
+            grow(n_ + n);
+        return {buf_ + n_, cap_ - n_};
+    }
+    JUTIL_INLINE void commit(const std::size_t n) noexcept { n_ += n; }
+
+    //! @brief Removes the first n bytes of the data
+    JUTIL_INLINE void consume(const std::size_t n) noexcept
+    {
+        memmove(buf_, buf_ + n, n_ - n);
+        n_ -= n;
+    }
+
+    void grow(std::size_t n);
+
+    std::unique_ptr<char[]> own_; // null while in given memory
+    char *buf_;
+    std::size_t n_ = 0, cap_ = defcap;
+};
+
 //
 // MESSAGE
 //
@@ -130,4 +267,70 @@ struct message {
     string body;
 };
 
+//
+// REQUEST PARSER
+//
+
+//! @brief Resumable parser of a request arriving in pieces; every received byte is scanned once
+//!
+//! Bodies delimited by Content-Length or chunked transfer coding are supported. The message
+//! views the received bytes, in which a chunked body is decoded in place.
+//!
+//! Usage example:
+//!
+//!     request_parser prs;
+//!     while ((r = prs.parse(buf.data(), buf.data() + buf.size(), msg)) == result::incomplete)
+//!         ...; // receive more into buf
+//!     ...;     // use msg, then drop prs.size() bytes of buf
+//!     prs.reset();
+//!
+class request_parser
+{
+  public:
+    enum class result : unsigned char { incomplete, complete, bad, too_large, header_too_large };
+    static constexpr auto max_body   = 1_uz << 20;
+    static constexpr auto max_header = 16_uz << 10; // including the request line
+    static constexpr auto max_line   = 4096_uz;     // of chunk-size and trailer lines
+
+    //! @brief Continues parsing a request with the bytes received so far
+    //! @param f Pointer to the beginning of the request; may change between calls, as long as
+    //! the bytes received so far move along
+    //! @param l Pointer to the end of the bytes received so far; followed by at least
+    //! `parse_pad` readable bytes
+    //! @param msg Object to represent the request; set once it is complete
+    //! @return complete once the request is, in which case it takes `size()` bytes
+    result parse(char *const f, char *const l, message &msg);
+
+    //! @brief Number of bytes of the request parsed so far
+    [[nodiscard]] JUTIL_INLINE std::size_t size() const noexcept { return pos_; }
+
+    //! @brief Prepares for the next request
+    JUTIL_INLINE void reset() noexcept { *this = {}; }
+
+  private:
+    enum class state : unsigned char {
+        header,
+        length,
+        chunk_size,
+        chunk_data,
+        chunk_end,
+        trailer,
+        done
+    };
+
+    //! @brief Finds the LF ending the line beginning at `pos_`, resuming the search where the
+    //! previous call left off
+    //! @return Offset of the LF, or npos if it hasn't been received
+    [[nodiscard]] std::size_t line_end(const char *f, std::size_t n) noexcept;
+    [[nodiscard]] result start_body(const message &msg) noexcept;
+
+    state st_         = state::header;
+    std::size_t pos_  = 0; // bytes consumed
+    std::size_t scan_ = 0; // bytes searched for the end of the header or the current line
+    std::size_t hdr_  = 0; // length of the header, including the empty line
+    std::size_t body_ = 0; // length of the body, as decoded so far
+    std::size_t rem_  = 0; // bytes left of the body or the current chunk
+    const char *base_ = nullptr; // beginning of the request when its header was parsed
+};
+
 #include "lmacro_end.h"
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <vector>
+
+#include "format.h"
+#include "jutil.h"
+
+//! @brief Counters and histograms that each have a single writing thread and are summed up
+//! across threads when read
+//!
+//! Usage example:
+//!
+//!     struct alignas(64) conn_metrics {
+//!         metrics::counter accepted;
+//!     };
+//!     metrics::per_thread<conn_metrics> g_m;
+//!
+//!     g_m.local().accepted.add(); // on the thread's own cache lines
+//!     uint64_t n = 0;
+//!     g_m.for_each(L(n += x.accepted.get(), &));
+//!
+namespace metrics
+{
+//! @brief Counter written by one thread; an update is a plain load and store rather than a locked
+//! read-modify-write, and other threads read a value it held at some point
+struct counter {
+    JUTIL_INLINE void add(const uint64_t n = 1) noexcept
+    {
+        v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+    JUTIL_INLINE void sub(const uint64_t n = 1) noexcept
+    {
+        v.store(v.load(std::memory_order_relaxed) - n, std::memory_order_relaxed);
+    }
+    [[nodiscard]] JUTIL_INLINE uint64_t get() const noexcept
+    {
+        return v.load(std::memory_order_relaxed);
+    }
+
+    std::atomic<uint64_t> v{0};
+};
+
+//! @brief Log-linear histogram of durations in ns: each power of two from `min_exp` to `max_exp`
+//! is split into `subs` buckets of equal width, so the bounds of a bucket are within 25% of each
+//! other. Shorter durations fall into the first bucket, longer ones into the last.
+struct histogram {
+    static constexpr unsigned sub_bits = 2, subs = 1u << sub_bits;
+    static constexpr unsigned min_exp = 8, max_exp = 34; // 256 ns to ~17 s
+    static constexpr auto nbuckets    = 1 + (max_exp - min_exp) * subs + 1;
+
+    [[nodiscard]] static constexpr JUTIL_INLINE std::size_t bucket(const uint64_t ns) noexcept
+    {
+        const auto e = static_cast<unsigned>(std::bit_width(ns)) - 1;
+        if (ns < uint64_t{1} << min_exp)
+            return 0;
+        if (e >= max_exp)
+            return nbuckets - 1;
+        return 1 + (e - min_exp) * subs + (ns >> (e - sub_bits) & (subs - 1));
+    }
+    //! @brief Exclusive upper bound of a bucket in ns; 0 for the last, which is unbounded
+    [[nodiscard]] static constexpr uint64_t upper_ns(const std::size_t b) noexcept
+    {
+        if (b == 0)
+            return uint64_t{1} << min_exp;
+        if (b == nbuckets - 1)
+            return 0;
+        const auto e = min_exp + (b - 1) / subs;
+        return (subs + (b - 1) % subs + 1) << (e - sub_bits);
+    }
+
+    JUTIL_INLINE void add(const uint64_t ns) noexcept
+    {
+        counts[bucket(ns)].add();
+        sum.add(ns);
+    }
+
+    std::array<counter, nbuckets> counts;
+    counter sum; // of the durations, in ns
+};
+static_assert(histogram::bucket(255) == 0 && histogram::bucket(256) == 1 &&
+              histogram::bucket(319) == 1 && histogram::bucket(320) == 2 &&
+              histogram::upper_ns(1) == 320 && histogram::upper_ns(4) == 512 &&
+              histogram::bucket(uint64_t{1} << histogram::max_exp) == histogram::nbuckets - 1);
+
+//! @brief An instance of T for every thread that asks for one; instances outlive their threads,
+//! so what they counted isn't lost. T should be aligned to a cache line, lest the counters of
+//! different threads share one. There's to be one `per_thread` per T.
+template <class T>
+class per_thread {
+  public:
+    //! @brief Instance of the calling thread
+    [[nodiscard]] JUTIL_INLINE T &local()
+    {
+        thread_local T *t = nullptr;
+        if (!t) [[unlikely]] {
+            std::scoped_lock lk{mtx};
+            t = all.emplace_back(std::make_unique<T>()).get();
+        }
+        return *t;
+    }
+
+    //! @brief Calls f with every instance
+    template <class F>
+    void for_each(F &&f) const
+    {
+        std::scoped_lock lk{mtx};
+        for (const auto &t : all)
+            f(static_cast<const T &>(*t));
+    }
+
+  private:
+    mutable std::mutex mtx; // guards `all`
+    std::vector<std::unique_ptr<T>> all;
+};
+
+//! @brief Duration in ns formatted as seconds, as Prometheus expects
+struct seconds {
+    uint64_t ns;
+};
+} // namespace metrics
+
+template <>
+struct format::formatter<metrics::seconds> {
+    static char *format(char *d_f, const metrics::seconds &s) noexcept
+    {
+        return format::format(d_f, s.ns / 1'000'000'000, ".",
+                              fmt_width<9>(static_cast<uint32_t>(s.ns % 1'000'000'000)));
+    }
+    static std::size_t maxsz(const metrics::seconds &) noexcept { return 20 + 1 + 9; }
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <stdint.h>
+
+#include "jutil.h"
+#include "ticks.h"
+
+//! @brief Token buckets of clients, keyed by address, in a direct-mapped table of fixed size
+//!
+//! Memory stays bounded however many clients there are. A client whose slot is held by another
+//! takes it over if the other's bucket has refilled (i.e. it's been idle); otherwise the two share
+//! the bucket, so a collision can only make limiting stricter, never lenient. Not thread-safe:
+//! each worker has its own.
+//!
+//! Usage example:
+//!
+//!     rate_limiter rl{100, 20}; // 100 requests/s, bursts of 20
+//!     if (!rl.admit(client, ticks::now()))
+//!         ...; // reject
+//!
+class rate_limiter
+{
+  public:
+    static constexpr auto slot_bits = 14u, nslots = 1u << slot_bits;
+
+    //! @param rate Requests per second a client may make
+    //! @param burst Requests a client may make at once, after being idle; at least 1
+    rate_limiter(const double rate, const double burst)
+        : slots_{std::make_unique<slot[]>(nslots)}, per_tick_{rate / (ticks::per_us() * 1e6)},
+          burst_{std::max(burst, 1.0)}
+    {
+    }
+
+    //! @brief Takes a token from the bucket of a client, if there's one
+    //! @param now Current time in ticks
+    [[nodiscard]] JUTIL_INLINE bool admit(const uint64_t client, const uint64_t now) noexcept
+    {
+        auto &s           = slots_[client * 0x9e3779b97f4a7c15 >> (64 - slot_bits)];
+        const auto tokens = std::min(burst_, s.tokens + static_cast<double>(now - s.t) * per_tick_);
+        if (s.key != client && tokens == burst_)
+            s.key = client;
+        s.t = now;
+        if (tokens < 1) {
+            s.tokens = tokens;
+            return false;
+        }
+        s.tokens = tokens - 1;
+        return true;
+    }
+
+  private:
+    struct slot {
+        uint64_t key = 0, t = 0; // client, time of the last update in ticks
+        double tokens = 0;       // as of `t`
+    };
+    std::unique_ptr<slot[]> slots_;
+    double per_tick_, burst_;
+};
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "jutil.h"
+#include "message.h"
+
+//! @brief Read buffers of a worker, handed out to its connections one each
+//!
+//! The pool is owned by one thread; a connection gets a plain heap buffer when it runs out.
+//!
+//! Usage example:
+//!
+//!     read_pool pool{1024};
+//!     const auto s = pool.acquire();
+//!     rbuf rb = s == read_pool::npos ? rbuf{} : rbuf{pool.mem(s)};
+//!     ...
+//!     pool.release(s);
+//!
+class read_pool
+{
+  public:
+    static constexpr auto npos      = ~0_uz;
+    static constexpr auto slot_size = rbuf::defcap + parse_pad;
+
+    //! @param n Number of buffers, each `slot_size` bytes
+    explicit read_pool(const std::size_t n) : mem_{std::make_unique<char[]>(n * slot_size)}
+    {
+        free_.reserve(n);
+        for (auto s = n; s--;)
+            free_.push_back(s);
+    }
+
+    //! @brief Index of a free buffer, or npos if there's none
+    [[nodiscard]] JUTIL_INLINE std::size_t acquire() noexcept
+    {
+        if (free_.empty()) [[unlikely]]
+            return npos;
+        const auto s = free_.back();
+        free_.pop_back();
+        return s;
+    }
+    //! @brief Returns a buffer from `acquire` (npos included) to the pool
+    JUTIL_INLINE void release(const std::size_t s) noexcept
+    {
+        if (s != npos)
+            free_.push_back(s);
+    }
+
+    //! @brief Memory of buffer s
+    [[nodiscard]] JUTIL_INLINE std::span<char> mem(const std::size_t s) const noexcept
+    {
+        return {mem_.get() + s * slot_size, slot_size};
+    }
+
+  private:
+    std::unique_ptr<char[]> mem_;
+    std::vector<std::size_t> free_;
+};
@@ -42,14 +42,20 @@ function showlst(i = 0) {
     });
 }
 
+const maxres = 5000;
+let qseq = 0;
+
 (async () => {
-    const vocab = parseVocab(await (await fetch('api/vocab')).text());
     search.readOnly = false;
-    status.innerText = `ladattu ${vocab.length} alkiota`;
-    ontype = debounce(e => {
+    status.innerText = '';
+    ontype = debounce(async e => {
+        const seq = ++qseq;
+        const res = !e.value ? [] : parseVocab(await (await fetch(
+            `api/search?q=${encodeURIComponent(e.value)}&limit=${maxres}`)).text());
+        if (seq !== qseq)
+            return; // superseded by a later query
         obs.disconnect();
-        const re = new RegExp(e.value, 'i');
-        lst = !e.value ? [] : vocab.filter(([w, _]) => re.exec(w)).map(([w, d]) => `<tr><td>${w}<td><p>${d}`);
+        lst = res.map(([w, d]) => `<tr><td>${w}<td><p>${d}`);
         showlst();
     });
 })().catch(e => {
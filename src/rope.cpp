@@ -0,0 +1,73 @@
+#include "rope.h"
+
+#include <string.h>
+
+namespace
+{
+//! @brief Most chunks a thread keeps for reuse; the rest are freed as they're given back
+constexpr auto max_pooled = 1024_uz;
+
+//! @brief Chunks given back on a thread, linked through their first bytes
+struct pool {
+    pool() = default;
+    ~pool()
+    {
+        while (head) {
+            const auto c = head;
+            memcpy(&head, c, sizeof(head));
+            delete[] c;
+        }
+    }
+    NO_COPY_MOVE(pool);
+
+    char *head = nullptr;
+    std::size_t n = 0;
+};
+thread_local pool t_pool;
+} // namespace
+
+char *rope::take()
+{
+    auto &p = t_pool;
+    if (const auto c = p.head) {
+        memcpy(&p.head, c, sizeof(p.head));
+        --p.n;
+        return c;
+    }
+    return new char[chunk_size];
+}
+
+void rope::give(char *const c) noexcept
+{
+    auto &p = t_pool;
+    if (p.n == max_pooled) {
+        delete[] c;
+        return;
+    }
+    memcpy(c, &p.head, sizeof(p.head));
+    p.head = c;
+    ++p.n;
+}
+
+void rope::clear() noexcept
+{
+    for (auto i = chunks_.size(); --i;)
+        give(chunks_[i]);
+    chunks_.resize(1);
+    cur_ = chunks_[0];
+    end_ = cur_ + chunk_size;
+}
+
+void rope::append(std::string_view s)
+{
+    for (;;) {
+        const auto k = std::min(s.size(), room());
+        cur_         = std::copy_n(s.data(), k, cur_);
+        s.remove_prefix(k);
+        if (s.empty())
+            return;
+        chunks_.push_back(take());
+        cur_ = chunks_.back();
+        end_ = cur_ + chunk_size;
+    }
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "format.h"
+#include "jutil.h"
+
+//! @brief Append-only text in fixed-size chunks, drawn from a pool of the thread
+//!
+//! Unlike `buffer`'s, growth never moves or copies the contents: a full chunk is just followed by
+//! another. Chunks are filled up, so byte i is at `i % chunk_size` in chunk `i / chunk_size`. A
+//! `put` is formatted in place when its `format::maxsz` fits in the last chunk; otherwise its
+//! arguments are put one at a time and split across chunks, so that e.g. the estimate of an
+//! `escaped` value is never reserved whole. The contents are read as contiguous segments, e.g.
+//! into a buffer sequence for a gathered write.
+//!
+//! Usage example:
+//!
+//!     rope r;
+//!     r.put("content-length: ", n, "\r\n\r\n");
+//!     std::vector<boost::asio::const_buffer> iov;
+//!     r.segments(0, r.size(), [&](const char *p, std::size_t n) { iov.emplace_back(p, n); });
+//!
+class rope
+{
+  public:
+    static constexpr auto chunk_size = 4096_uz;
+
+    rope() : chunks_{take()}, cur_{chunks_[0]}, end_{cur_ + chunk_size} {}
+    ~rope()
+    {
+        for (const auto c : chunks_)
+            give(c);
+    }
+    NO_COPY_MOVE(rope);
+
+    //
+    // DATA RETRIEVAL
+    //
+    [[nodiscard]] JUTIL_INLINE std::size_t size() const noexcept
+    {
+        return (chunks_.size() - 1) * chunk_size + static_cast<std::size_t>(cur_ - chunks_.back());
+    }
+    [[nodiscard]] JUTIL_INLINE char operator[](const std::size_t i) const noexcept
+    {
+        return chunks_[i / chunk_size][i % chunk_size];
+    }
+    //! @brief Calls f(p, n) for each contiguous segment [p, p+n) of bytes [off, off+n), in order
+    template <class F>
+    JUTIL_INLINE void segments(std::size_t off, std::size_t n, F &&f) const
+    {
+        while (n) {
+            const auto o = off % chunk_size;
+            const auto k = std::min(n, chunk_size - o);
+            f(static_cast<const char *>(chunks_[off / chunk_size] + o), k);
+            off += k;
+            n -= k;
+        }
+    }
+
+    //
+    // MODIFICATION
+    //
+    //! @brief Empties the rope, giving back every chunk but the first to the pool
+    void clear() noexcept;
+
+    template <bool Append = false, class... Args>
+    JUTIL_INLINE std::size_t put(Args &&...args)
+    {
+        if constexpr (!Append)
+            clear();
+        if (format::maxsz(args...) <= room()) [[likely]]
+            cur_ = format::format(cur_, args...);
+        else
+            (put_one(args), ...);
+        return size();
+    }
+
+  private:
+    [[nodiscard]] JUTIL_INLINE std::size_t room() const noexcept
+    {
+        return static_cast<std::size_t>(end_ - cur_);
+    }
+
+    template <class T>
+    void put_one(const T &x)
+    {
+        const auto sz = format::maxsz(x);
+        if (sz <= room())
+            cur_ = format::format(cur_, x);
+        else if constexpr (std::is_array_v<T>)
+            append({x, std::extent_v<T> - 1});
+        else if constexpr (std::is_convertible_v<const T &, std::string_view>)
+            append(x);
+        else if constexpr (std::is_same_v<T, format::escaped>) {
+            // In slices whose escaped forms fit in a chunk
+            for (auto f = x.f; f != x.l;) {
+                const auto k = std::min(chunk_size / 5, static_cast<std::size_t>(x.l - f));
+                put_formatted(format::escaped{{f, k}}, k * 5);
+                f += k;
+            }
+        } else
+            put_formatted(x, sz);
+    }
+    //! @brief Formats x, of given maxsz, in place if it fits in the last chunk and through
+    //! scratch memory otherwise
+    template <class T>
+    void put_formatted(const T &x, const std::size_t sz)
+    {
+        if (sz <= room()) {
+            cur_ = format::format(cur_, x);
+        } else if (sz <= chunk_size) {
+            char s[chunk_size];
+            append({s, static_cast<std::size_t>(format::format(s, x) - s)});
+        } else {
+            const auto s = std::make_unique_for_overwrite<char[]>(sz);
+            append({s.get(), static_cast<std::size_t>(format::format(s.get(), x) - s.get())});
+        }
+    }
+    //! @brief Copies bytes in, across as many chunks as they take
+    void append(std::string_view s);
+
+    [[nodiscard]] static char *take();
+    static void give(char *c) noexcept;
+
+    std::vector<char *> chunks_; // never empty
+    char *cur_, *end_;           // in the last chunk
+};
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <stdexcept>
+#include <stdint.h>
+#include <string.h>
+#include <string_view>
+
+#include "jutil.h"
+
+namespace router
+{
+//! @brief Hash of a key, computable at compile time; the input is consumed 8 bytes at a time
+[[nodiscard]] constexpr JUTIL_INLINE uint64_t hash(const std::string_view s) noexcept
+{
+    const auto load = [](const char *p, const std::size_t n) {
+        uint64_t w = 0;
+        if (std::is_constant_evaluated())
+            for (auto i = 0_uz; i < n; ++i)
+                w |= uint64_t{static_cast<unsigned char>(p[i])} << (i * 8);
+        else
+            memcpy(&w, p, n);
+        return w;
+    };
+    uint64_t h = 0x9e3779b97f4a7c15 ^ s.size();
+    auto p     = s.data();
+    auto n     = s.size();
+    for (; n > 8; p += 8, n -= 8) {
+        h = (h ^ load(p, 8)) * 0xff51afd7ed558ccd;
+        h ^= h >> 32;
+    }
+    // The rest is covered by overlapping loads (the length being part of the hash already)
+    const auto w = n >= 4   ? load(p, 4) | load(p + n - 4, 4) << 32
+                   : n != 0 ? load(p, 1) | load(p + n / 2, 1) << 8 | load(p + n - 1, 1) << 16
+                            : 0;
+    h            = (h ^ w) * 0xc4ceb9fe1a85ec53;
+    h ^= h >> 32;
+    h *= 0xff51afd7ed558ccd;
+    return h ^ (h >> 29);
+}
+
+//! @brief Perfect hash table over a fixed set of keys, built at compile time
+//!
+//! Keys are hashed into buckets of ~2 keys; each bucket has a displacement, found while building,
+//! that maps its keys into distinct free slots. Thus a lookup hashes the key once and compares it
+//! to a single candidate, no matter the number of keys.
+//!
+//! Usage example:
+//!
+//!     constexpr router::phash<3> ph{{"/", "/a", "/b"}};
+//!     static_assert(ph.find("/a") == 1 && ph.find("/c") == 3);
+//!
+template <std::size_t N>
+struct phash {
+    static_assert(N > 0 && N < UINT16_MAX);
+    static constexpr auto nbuckets = std::bit_ceil(std::max(N / 2, 1_uz));
+    static constexpr auto nslots   = std::bit_ceil(std::max(N * 2, 2_uz));
+    static constexpr auto slot_shift = 64 - std::countr_zero(nslots);
+
+    constexpr explicit phash(const std::array<std::string_view, N> &keys) : keys{keys}
+    {
+        std::array<uint64_t, N> hs;
+        std::array<uint16_t, N> order; // key indices grouped by bucket, fullest bucket first
+        std::array<uint16_t, nbuckets> bsz{};
+        for (auto i = 0_uz; i < N; ++i) {
+            hs[i]    = hash(keys[i]);
+            order[i] = static_cast<uint16_t>(i);
+            ++bsz[hs[i] & (nbuckets - 1)];
+        }
+        const auto bucket = [&](const uint16_t i) { return hs[i] & (nbuckets - 1); };
+        std::sort(order.begin(), order.end(), [&](const uint16_t a, const uint16_t b) {
+            return bsz[bucket(a)] != bsz[bucket(b)] ? bsz[bucket(a)] > bsz[bucket(b)]
+                                                    : bucket(a) < bucket(b);
+        });
+        slots.fill(static_cast<uint16_t>(N));
+        disp.fill(0);
+        for (auto f = 0_uz; f < N;) {
+            const auto b = bucket(order[f]);
+            const auto l = f + bsz[b];
+            for (auto i = f; i < l; ++i)
+                for (auto j = f; j < i; ++j)
+                    if (hs[order[i]] == hs[order[j]])
+                        throw std::invalid_argument{"router::phash: duplicate key"};
+            for (uint32_t d = 0;; ++d) {
+                if (d == UINT16_MAX)
+                    throw std::logic_error{"router::phash: no displacement found"};
+                auto ok = true;
+                for (auto i = f; ok && i < l; ++i) {
+                    const auto s = slot(hs[order[i]], d);
+                    ok           = slots[s] == N;
+                    for (auto j = f; ok && j < i; ++j)
+                        ok = s != slot(hs[order[j]], d);
+                }
+                if (!ok)
+                    continue;
+                disp[b] = static_cast<uint16_t>(d);
+                for (auto i = f; i < l; ++i)
+                    slots[slot(hs[order[i]], d)] = order[i];
+                break;
+            }
+            f = l;
+        }
+    }
+
+    //! @return Index of given key, or N if it isn't one of the keys
+    [[nodiscard]] constexpr JUTIL_INLINE std::size_t find(const std::string_view k) const noexcept
+    {
+        const auto h = hash(k);
+        const auto i = slots[slot(h, disp[h & (nbuckets - 1)])];
+        return i != N && keys[i] == k ? i : N;
+    }
+
+    std::array<std::string_view, N> keys;
+    std::array<uint16_t, nbuckets> disp;
+    std::array<uint16_t, nslots> slots; // index of the key in each slot, or N
+
+  private:
+    [[nodiscard]] static constexpr JUTIL_INLINE std::size_t slot(const uint64_t h,
+                                                                  const uint32_t d) noexcept
+    {
+        return static_cast<std::size_t>(((h ^ (d * 0x9e3779b97f4a7c15)) * 0xbf58476d1ce4e5b9) >>
+                                        slot_shift);
+    }
+};
+} // namespace router
@@ -0,0 +1,361 @@
+#include "search.h"
+
+#include <algorithm>
+#include <bit>
+#include <limits>
+#include <string.h>
+#include <string>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define SEARCH_TARGET_AVX2
+#else
+#define SEARCH_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+#include "lmacro_begin.h"
+
+namespace search
+{
+char *fold(const char *f, const char *const l, char *d_f) noexcept
+{
+    for (; f != l; ++f) {
+        const auto c = static_cast<unsigned char>(*f);
+        if (to_unsigned(c - 'A') <= 'Z' - 'A')
+            *d_f++ = static_cast<char>(c + ('a' - 'A'));
+        else if (c == 0xc3 && f + 1 != l && to_unsigned(f[1] - '\x80') <= 0x1e && f[1] != '\x97') {
+            // À-Þ (U+00C0-U+00DE, sans ×) are C3 80-9E; their lower case forms C3 A0-BE
+            *d_f++ = *f++;
+            *d_f++ = static_cast<char>(*f + 0x20);
+        } else
+            *d_f++ = static_cast<char>(c);
+    }
+    return d_f;
+}
+
+//
+// scanning
+//
+
+namespace
+{
+//! @brief Whether c is the lower case form of a Latin-1 letter's second UTF-8 byte (C3 A0-BE)
+JUTIL_INLINE bool is_l1_lower(const unsigned char c) noexcept
+{
+    return to_unsigned(c - 0xa0) <= 0x1e && c != 0xb7;
+}
+JUTIL_INLINE char other_case(const std::string_view fq, const std::size_t i) noexcept
+{
+    const auto c = static_cast<unsigned char>(fq[i]);
+    if (to_unsigned(c - 'a') <= 'z' - 'a')
+        return static_cast<char>(c - ('a' - 'A'));
+    if (i && fq[i - 1] == '\xc3' && is_l1_lower(c))
+        return static_cast<char>(c - 0x20);
+    return static_cast<char>(c);
+}
+} // namespace
+
+needle::needle(const std::string_view fq) noexcept
+    : fq{fq}, a0{fq.front()}, b0{other_case(fq, 0)}, ak{fq.back()},
+      bk{other_case(fq, fq.size() - 1)}
+{
+}
+
+bool needle::verify(const char *const p) const noexcept
+{
+    for (auto i = 0_uz; i < fq.size(); ++i) {
+        auto c = static_cast<unsigned char>(p[i]);
+        if (to_unsigned(c - 'A') <= 'Z' - 'A' ||
+            (i && p[i - 1] == '\xc3' && to_unsigned(c - 0x80) <= 0x1e && c != 0x97))
+            c += 0x20;
+        if (static_cast<char>(c) != fq[i])
+            return false;
+    }
+    return true;
+}
+
+namespace kernels
+{
+const char *scan_scalar(const char *f, const char *const l, const needle &nd) noexcept
+{
+    if (static_cast<std::size_t>(l - f) < nd.size())
+        return l;
+    for (const auto last = l - nd.size(); f <= last; ++f)
+        if ((*f == nd.a0 || *f == nd.b0) && nd.verify(f))
+            return f;
+    return l;
+}
+
+#ifdef SEARCH_HAS_SIMD_KERNELS
+const char *scan_sse2(const char *f, const char *const l, const needle &nd) noexcept
+{
+    const auto k  = nd.size() - 1;
+    const auto a0 = _mm_set1_epi8(nd.a0), b0 = _mm_set1_epi8(nd.b0);
+    const auto ak = _mm_set1_epi8(nd.ak), bk = _mm_set1_epi8(nd.bk);
+    for (; l - f >= static_cast<std::ptrdiff_t>(k + 16); f += 16) {
+        const auto h0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(f));
+        const auto hk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(f + k));
+        auto m        = static_cast<unsigned>(_mm_movemask_epi8(
+            _mm_and_si128(_mm_or_si128(_mm_cmpeq_epi8(h0, a0), _mm_cmpeq_epi8(h0, b0)),
+                                 _mm_or_si128(_mm_cmpeq_epi8(hk, ak), _mm_cmpeq_epi8(hk, bk)))));
+        for (; m; m &= m - 1)
+            if (const auto p = f + std::countr_zero(m); nd.verify(p))
+                return p;
+    }
+    return scan_scalar(f, l, nd);
+}
+
+SEARCH_TARGET_AVX2 const char *scan_avx2(const char *f, const char *const l,
+                                         const needle &nd) noexcept
+{
+    const auto k  = nd.size() - 1;
+    const auto a0 = _mm256_set1_epi8(nd.a0), b0 = _mm256_set1_epi8(nd.b0);
+    const auto ak = _mm256_set1_epi8(nd.ak), bk = _mm256_set1_epi8(nd.bk);
+    for (; l - f >= static_cast<std::ptrdiff_t>(k + 32); f += 32) {
+        const auto h0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(f));
+        const auto hk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(f + k));
+        auto m        = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_and_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(h0, a0), _mm256_cmpeq_epi8(h0, b0)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(hk, ak), _mm256_cmpeq_epi8(hk, bk)))));
+        for (; m; m &= m - 1)
+            if (const auto p = f + std::countr_zero(m); nd.verify(p))
+                return p;
+    }
+    return scan_sse2(f, l, nd);
+}
+
+bool has_avx2() noexcept
+{
+#ifdef _MSC_VER
+    int r[4];
+    __cpuid(r, 1);
+    const bool osxsave = r[2] & (1 << 27), avx = r[2] & (1 << 28);
+    if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+        return false;
+    __cpuidex(r, 7, 0);
+    return r[1] & (1 << 5);
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+} // namespace kernels
+
+const char *scan(const char *f, const char *const l, const needle &nd) noexcept
+{
+#ifdef SEARCH_HAS_SIMD_KERNELS
+    static const auto k = kernels::has_avx2() ? kernels::scan_avx2 : kernels::scan_sse2;
+#else
+    static constexpr auto k = kernels::scan_scalar;
+#endif
+    return k(f, l, nd);
+}
+
+//
+// postings
+//
+
+namespace
+{
+JUTIL_INLINE void put_varint(std::vector<uint8_t> &v, uint32_t x)
+{
+    for (; x >= 0x80; x >>= 7)
+        v.push_back(static_cast<uint8_t>(x | 0x80));
+    v.push_back(static_cast<uint8_t>(x));
+}
+
+//! @brief Iterates over a posting list
+struct cursor {
+    JUTIL_INLINE bool next() noexcept
+    {
+        if (p == l)
+            return false;
+        uint32_t d = 0;
+        for (int sh = 0;; sh += 7) {
+            const auto b = *p++;
+            d |= static_cast<uint32_t>(b & 0x7f) << sh;
+            if (!(b & 0x80))
+                break;
+        }
+        v += d;
+        return true;
+    }
+    //! @brief Advances to the first entry not less than x
+    JUTIL_INLINE bool seek(const uint32_t x) noexcept
+    {
+        while (v < x)
+            if (!next())
+                return false;
+        return true;
+    }
+    const uint8_t *p, *l;
+    uint32_t n, v = 0;
+};
+
+JUTIL_INLINE uint32_t trigram(const char *const p) noexcept
+{
+    return static_cast<uint32_t>(static_cast<unsigned char>(p[0])) << 16 |
+           static_cast<uint32_t>(static_cast<unsigned char>(p[1])) << 8 |
+           static_cast<uint32_t>(static_cast<unsigned char>(p[2]));
+}
+
+JUTIL_INLINE bool contains(const std::string_view term, const needle &nd) noexcept
+{
+    const auto l = term.data() + term.size();
+    return kernels::scan_scalar(term.data(), l, nd) != l;
+}
+} // namespace
+
+//
+// index
+//
+
+bool index::build(const std::string_view txt)
+{
+    if (txt.size() >= std::numeric_limits<uint32_t>::max())
+        return false;
+    text = txt;
+
+    // Line starts
+    lines.clear();
+    lines.push_back(0);
+    for (auto p = text.data(), l = text.data() + text.size();
+         (p = static_cast<const char *>(memchr(p, '\n', static_cast<std::size_t>(l - p))));)
+        lines.push_back(static_cast<uint32_t>(++p - text.data()));
+    if (!text.ends_with('\n'))
+        lines.push_back(static_cast<uint32_t>(text.size() + 1));
+
+    // Term column
+    tcol.clear();
+    tcol_offs.clear();
+    for (uint32_t i = 0; i < size(); ++i) {
+        const auto t = term(i);
+        tcol_offs.push_back(static_cast<uint32_t>(tcol.size()));
+        tcol.insert(tcol.end(), t.begin(), t.end());
+        tcol.push_back('\n');
+    }
+    tcol_offs.push_back(static_cast<uint32_t>(tcol.size()));
+
+    // (trigram, entry) pairs, sorted and unique
+    std::vector<uint64_t> ps;
+    std::string ft;
+    for (uint32_t i = 0; i < size(); ++i) {
+        const auto t = term(i);
+        ft.resize(t.size());
+        fold(t.data(), t.data() + t.size(), ft.data());
+        for (auto j = 0_uz; j + 2 < ft.size(); ++j)
+            ps.push_back(static_cast<uint64_t>(trigram(&ft[j])) << 32 | i);
+    }
+    sr::sort(ps);
+    ps.erase(std::unique(ps.begin(), ps.end()), ps.end());
+
+    // Posting lists
+    keys.clear();
+    offs.clear();
+    cnts.clear();
+    postings.clear();
+    uint32_t prev = 0;
+    for (const auto x : ps) {
+        const auto k = static_cast<uint32_t>(x >> 32), id = static_cast<uint32_t>(x);
+        if (keys.empty() || keys.back() != k) {
+            keys.push_back(k);
+            offs.push_back(static_cast<uint32_t>(postings.size()));
+            cnts.push_back(0);
+            prev = 0;
+        }
+        put_varint(postings, id - prev);
+        ++cnts.back();
+        prev = id;
+    }
+    offs.push_back(static_cast<uint32_t>(postings.size()));
+    return true;
+}
+
+void index::find(const std::string_view q, const std::size_t limit,
+                 std::vector<uint32_t> &out) const
+{
+    out.clear();
+    if (!limit)
+        return;
+
+    thread_local std::string fq_;
+    fq_.resize(q.size());
+    fold(q.data(), q.data() + q.size(), fq_.data());
+    const std::string_view fq = fq_;
+    if (fq.find('\n') != std::string_view::npos)
+        return; // can't match as terms are lines
+    if (fq.empty()) {
+        for (uint32_t i = 0; i < size() && out.size() < limit; ++i)
+            out.push_back(i);
+        return;
+    }
+    const needle nd{fq};
+
+    // Queries too short to have a trigram are scanned for in the term column
+    if (fq.size() < 3) {
+        const auto col = tcol.data(), l = tcol.data() + tcol.size();
+        for (auto f = col; (f = scan(f, l, nd)) != l;) {
+            const auto i = static_cast<uint32_t>(
+                sr::upper_bound(tcol_offs, static_cast<uint32_t>(f - col)) - tcol_offs.begin() - 1);
+            out.push_back(i);
+            if (out.size() == limit)
+                return;
+            f = col + tcol_offs[i + 1];
+        }
+        return;
+    }
+
+    // Cursors over the posting lists of the query's distinct trigrams; all of them must match
+    constexpr auto maxcs = 8_uz;
+    cursor cs[maxcs + 1];
+    auto ncs = 0_uz;
+    for (auto j = 0_uz; j + 2 < fq.size(); ++j) {
+        const auto k  = trigram(&fq[j]);
+        const auto it = sr::lower_bound(keys, k);
+        if (it == keys.end() || *it != k)
+            return;
+        const auto i = static_cast<std::size_t>(it - keys.begin());
+        const cursor c{&postings[offs[i]], &postings[0] + offs[i + 1], cnts[i]};
+        if (std::any_of(cs, cs + ncs, L(x.p == c.p, &)))
+            continue;
+
+        // Keep the shortest lists; a dropped one only means more candidates to verify
+        const auto pos = std::upper_bound(cs, cs + ncs, c.n, [](auto n, auto &x) { return n < x.n; });
+        std::copy_backward(pos, cs + ncs, cs + ncs + 1);
+        *pos = c;
+        ncs  = std::min(ncs + 1, maxcs);
+    }
+
+    // Leapfrog intersection, shortest list leading
+    for (auto &c : std::span{cs, ncs})
+        if (!c.next())
+            return;
+    for (auto cand = cs[0].v;;) {
+        auto all = true;
+        for (auto &c : std::span{cs + 1, ncs - 1}) {
+            if (!c.seek(cand))
+                return;
+            if (c.v != cand) {
+                all = false;
+                if (!cs[0].seek(c.v))
+                    return;
+                cand = cs[0].v;
+                break;
+            }
+        }
+        if (!all)
+            continue;
+        if (contains(term(cand), nd)) {
+            out.push_back(cand);
+            if (out.size() == limit)
+                return;
+        }
+        if (!cs[0].next())
+            return;
+        cand = cs[0].v;
+    }
+}
+} // namespace search
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <stdint.h>
+#include <string_view>
+#include <vector>
+
+#include "jutil.h"
+
+namespace search
+{
+//! @brief Folds ASCII and (UTF-8 encoded) Latin-1 letters to lower case
+//! @param f Pointer to the beginning of the input
+//! @param l Pointer to the end of the input
+//! @param d_f Output of l - f chars; may be f
+//! @return Pointer to the end of the output
+char *fold(const char *f, const char *const l, char *d_f) noexcept;
+
+//
+// scanning
+//
+
+//! @brief Folded query prepared for case-insensitive scanning
+struct needle {
+    //! @param fq Folded query; must be non-empty and outlive the needle
+    explicit needle(std::string_view fq) noexcept;
+
+    //! @brief Whether [p:p+size()) folds to the query
+    [[nodiscard]] bool verify(const char *p) const noexcept;
+    [[nodiscard]] JUTIL_INLINE std::size_t size() const noexcept { return fq.size(); }
+
+    std::string_view fq;
+    char a0, b0, ak, bk; // either case of the first and last byte
+};
+
+//! @brief Finds the first case-insensitive occurrence of a needle
+//! @param f Pointer to the beginning of the haystack
+//! @param l Pointer to the end of the haystack
+//! @return Pointer to the occurrence, or l if there's none
+//!
+//! Candidates are the positions where the first and last byte of the needle match, tested
+//! 16 (SSE2) or 32 (AVX2) at a time; the widest kernel the CPU supports is picked at startup.
+const char *scan(const char *f, const char *const l, const needle &nd) noexcept;
+
+namespace kernels
+{
+using scan_fn = const char *(*)(const char *, const char *, const needle &) noexcept;
+const char *scan_scalar(const char *f, const char *const l, const needle &nd) noexcept;
+#if defined(__x86_64__) || defined(_M_X64)
+#define SEARCH_HAS_SIMD_KERNELS 1
+const char *scan_sse2(const char *f, const char *const l, const needle &nd) noexcept;
+const char *scan_avx2(const char *f, const char *const l, const needle &nd) noexcept;
+bool has_avx2() noexcept;
+#endif
+} // namespace kernels
+
+//! @brief Term/definition pairs of a vocab text, indexed by case-folded trigrams of the terms
+//!
+//! Postings of each trigram are the ascending ids of the entries containing it, delta-coded
+//! as LEB128 varints. Queries intersect the shortest posting lists and verify the candidates.
+//! Queries too short for a trigram are scanned for in a column of all terms.
+struct index {
+    //! @brief Indexes given text of alternating term and definition lines
+    //! @param text Vocab text; must outlive the index
+    //! @return Whether the text was small enough to be indexed
+    bool build(std::string_view text);
+
+    [[nodiscard]] JUTIL_INLINE std::size_t size() const noexcept
+    {
+        return (lines.size() - 1) / 2;
+    }
+    [[nodiscard]] JUTIL_INLINE std::string_view term(const uint32_t i) const noexcept
+    {
+        return line(2 * i);
+    }
+    [[nodiscard]] JUTIL_INLINE std::string_view def(const uint32_t i) const noexcept
+    {
+        return line(2 * i + 1);
+    }
+
+    //! @brief Finds entries whose term contains given query, case-insensitively
+    //! @param q Query; needn't be folded
+    //! @param limit Maximum number of entries to find
+    //! @param out Receives ids of the matching entries in ascending order
+    void find(std::string_view q, std::size_t limit, std::vector<uint32_t> &out) const;
+
+    std::string_view text;
+    std::vector<uint32_t> lines;    // offsets of line starts, plus that of a line past the end
+    std::vector<char> tcol;         // terms separated by newlines
+    std::vector<uint32_t> tcol_offs; // offsets of terms in tcol, plus one past the end
+    std::vector<uint32_t> keys;     // sorted trigrams
+    std::vector<uint32_t> offs;     // offs[i]: start of keys[i]'s postings, plus the end
+    std::vector<uint32_t> cnts;     // cnts[i]: number of entries in keys[i]'s postings
+    std::vector<uint8_t> postings;
+
+  private:
+    [[nodiscard]] JUTIL_INLINE std::string_view line(const uint32_t i) const noexcept
+    {
+        auto sv = text.substr(lines[i], lines[i + 1] - lines[i] - 1);
+        if (sv.ends_with('\r'))
+            sv.remove_suffix(1);
+        return sv;
+    }
+};
+} // namespace search
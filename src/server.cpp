@@ -1,16 +1,30 @@
 ﻿#include <boost/asio.hpp>
 #include <boost/asio/experimental/as_tuple.hpp>
-#include <boost/asio/experimental/awaitable_operators.hpp>
-#include <boost/preprocessor/cat.hpp>
+#include <charconv>
 #include <chrono>
+#include <errno.h>
 #include <memory>
+#include <optional>
 #include <stdio.h>
 #include <stdlib.h>
+#include <thread>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
 
+#include "alloc_count.h"
 #include "buffer.h"
 #include "format.h"
 #include "jutil.h"
 #include "message.h"
+#include "metrics.h"
+#include "rate_limit.h"
+#include "read_pool.h"
+#include "rope.h"
+#include "router.h"
+#include "server.h"
+#include "ticks.h"
+#include "timer_wheel.h"
 #include "vocabserv.h"
 #include <res.h>
 
@@ -21,21 +35,519 @@
 namespace sc = std::chrono;
 namespace ba = boost::asio;
 
-[[nodiscard]] JUTIL_INLINE const std::string_view &get_mimetype(const std::string_view uri) noexcept
+[[nodiscard]] constexpr std::string_view get_mimetype(const std::string_view uri) noexcept
 {
-    static constexpr std::string_view exts[]{".js", ".css"};
-    static constexpr std::string_view types[]{"text/javascript", "text/css", "text/html"};
+    constexpr std::string_view exts[]{".js", ".css"};
+    constexpr std::string_view types[]{"text/javascript", "text/css", "text/html"};
     return types[find_if_unrl_idx(exts, L(uri.ends_with(x), =))];
 }
 
-#define STATIC_SV(X, ...)                                                                          \
-    [__VA_ARGS__]() -> const std::string_view & {                                                  \
-        static constexpr std::string_view BOOST_PP_CAT(x, __LINE__) = X;                           \
-        return BOOST_PP_CAT(x, __LINE__);                                                          \
-    }()
+//
+// routing
+//
 
+//! @brief Generates the content of a route
+enum class handler : unsigned char { none, res, search, vocab_ver, vocab, metrics };
+
+//! @brief A path along with its handler for each method and the type of its content
+struct route {
+    std::string_view path, type;
+    std::array<handler, static_cast<std::size_t>(method::err)> on{}; // by method
+    std::size_t res = 0;                                            // for handler::res
+};
+
+[[nodiscard]] constexpr route get(const std::string_view path, const std::string_view type,
+                                  const handler h, const std::size_t res = 0) noexcept
+{
+    route r{path, type, {}, res};
+    r.on[static_cast<std::size_t>(method::GET)] = h;
+    return r;
+}
+
+//! @brief Every route: the resources of res.h followed by the API
+inline constexpr auto g_routes = [] {
+    constexpr std::array api{
+        get("/api/search", "text/plain", handler::search),
+        get("/api/vocabVer", "text/plain", handler::vocab_ver),
+        get("/api/vocab", "text/plain", handler::vocab),
+        get("/api/metrics", "text/plain; version=0.0.4", handler::metrics),
+    };
+    std::array<route, res::names.size() + api.size()> rs;
+    for (auto i = 0_uz; i < res::names.size(); ++i)
+        rs[i] = get(res::names[i], get_mimetype(res::names[i]), handler::res, i);
+    sr::copy(api, rs.begin() + res::names.size());
+    return rs;
+}();
+
+//! @brief Finds the route of a path in constant time
+inline constexpr router::phash g_router{[] {
+    std::array<std::string_view, g_routes.size()> paths;
+    sr::transform(g_routes, paths.begin(), &route::path);
+    return paths;
+}()};
+static_assert(g_routes.size() <= alog::access_log::max_targets);
+
+[[nodiscard]] consteval std::string_view route_type(const std::string_view path)
+{
+    return g_routes[g_router.find(path)].type;
+}
+
+//
+// metrics
+//
+
+//! @brief Statuses counted on their own; the rest are counted together
+inline constexpr std::array<uint16_t, 10> g_statuses{200, 304, 400, 404, 405,
+                                                     413, 429, 431, 503, 505};
+
+//! @brief Why admission control turned something away
+enum class rejection : unsigned char { connections, inflight, rate };
+inline constexpr std::array<std::string_view, 3> g_rejection_names{"connections", "inflight",
+                                                                   "rate"};
+
+//! @brief What a worker counts, on cache lines of its own
+struct alignas(64) worker_metrics {
+    metrics::counter accepted, active, bytes_out, timeouts, parse_errors;
+    std::array<metrics::counter, g_rejection_names.size()> rejected; // by rejection
+    // By route (then requests matching none) and status (then any other)
+    std::array<std::array<metrics::counter, g_statuses.size() + 1>, g_routes.size() + 1> requests;
+    std::array<metrics::histogram, alog::nphases> lat; // as timed for the access log
+};
+static metrics::per_thread<worker_metrics> g_metrics;
+
+[[nodiscard]] JUTIL_INLINE std::size_t status_idx(const uint16_t st) noexcept
+{
+    return find_if_unrl_idx(g_statuses, L(x == st, =));
+}
+
+//! @brief Appends the sum of every worker's metrics in the Prometheus text format:
+//! https://prometheus.io/docs/instrumenting/exposition_formats/
+static void write_metrics(rope &b)
+{
+    struct {
+        uint64_t accepted = 0, active = 0, bytes_out = 0, timeouts = 0, parse_errors = 0;
+        std::array<uint64_t, g_rejection_names.size()> rejected{};
+        std::array<std::array<uint64_t, g_statuses.size() + 1>, g_routes.size() + 1> requests{};
+        std::array<std::array<uint64_t, metrics::histogram::nbuckets>, alog::nphases> lat{};
+        std::array<uint64_t, alog::nphases> lat_sum{};
+    } s;
+    g_metrics.for_each([&](const worker_metrics &m) {
+        s.accepted += m.accepted.get();
+        s.active += m.active.get();
+        s.bytes_out += m.bytes_out.get();
+        s.timeouts += m.timeouts.get();
+        s.parse_errors += m.parse_errors.get();
+        for (auto i = 0_uz; i < s.rejected.size(); ++i)
+            s.rejected[i] += m.rejected[i].get();
+        for (auto r = 0_uz; r < s.requests.size(); ++r)
+            for (auto st = 0_uz; st < s.requests[r].size(); ++st)
+                s.requests[r][st] += m.requests[r][st].get();
+        for (auto p = 0_uz; p < alog::nphases; ++p) {
+            for (auto i = 0_uz; i < metrics::histogram::nbuckets; ++i)
+                s.lat[p][i] += m.lat[p].counts[i].get();
+            s.lat_sum[p] += m.lat[p].sum.get();
+        }
+    });
+
+    const auto scalar = [&](const std::string_view name, const std::string_view type,
+                            const std::string_view help, const uint64_t v) {
+        b.put<true>("# HELP vocabserv_", name, " ", help, "\n# TYPE vocabserv_", name, " ", type,
+                    "\nvocabserv_", name, " ", v, "\n");
+    };
+    scalar("connections_accepted_total", "counter", "Connections accepted.", s.accepted);
+    scalar("connections_active", "gauge", "Connections open.", s.active);
+    scalar("response_bytes_total", "counter", "Bytes of responses written.", s.bytes_out);
+    scalar("timeouts_total", "counter", "Connections closed for being idle.", s.timeouts);
+    scalar("parse_errors_total", "counter", "Requests rejected by the parser.", s.parse_errors);
+#ifdef VOCABSERV_COUNT_ALLOCS
+    scalar("allocations_total", "counter", "Calls to operator new on worker threads.",
+           alloc_count::get());
+#endif
+
+    b.put<true>("# HELP vocabserv_rejected_total Connections and requests turned away by admission "
+                "control, by the limit they hit.\n# TYPE vocabserv_rejected_total counter\n");
+    for (auto i = 0_uz; i < s.rejected.size(); ++i)
+        b.put<true>("vocabserv_rejected_total{limit=\"", g_rejection_names[i], "\"} ",
+                    s.rejected[i], "\n");
+
+    b.put<true>("# HELP vocabserv_requests_total Requests served, by route and status.\n"
+                "# TYPE vocabserv_requests_total counter\n");
+    for (auto r = 0_uz; r < s.requests.size(); ++r)
+        for (auto st = 0_uz; st < s.requests[r].size(); ++st) {
+            if (!s.requests[r][st])
+                continue;
+            b.put<true>("vocabserv_requests_total{route=\"",
+                        r < g_routes.size() ? g_routes[r].path : "other", "\",status=\"");
+            if (st < g_statuses.size())
+                b.put<true>(g_statuses[st]);
+            else
+                b.put<true>("other");
+            b.put<true>("\"} ", s.requests[r][st], "\n");
+        }
+
+    b.put<true>("# HELP vocabserv_phase_seconds Time taken by the phases of requests; writes are "
+                "timed per batch of pipelined responses.\n"
+                "# TYPE vocabserv_phase_seconds histogram\n");
+    for (auto p = 0_uz; p < alog::nphases; ++p) {
+        const auto ph = alog::phase_names[p];
+        uint64_t n    = 0;
+        for (auto i = 0_uz; i < metrics::histogram::nbuckets; ++i) {
+            n += s.lat[p][i];
+            b.put<true>("vocabserv_phase_seconds_bucket{phase=\"", ph, "\",le=\"");
+            if (const auto u = metrics::histogram::upper_ns(i))
+                b.put<true>(metrics::seconds{u});
+            else
+                b.put<true>("+Inf");
+            b.put<true>("\"} ", n, "\n");
+        }
+        b.put<true>("vocabserv_phase_seconds_sum{phase=\"", ph, "\"} ",
+                    metrics::seconds{s.lat_sum[p]}, "\nvocabserv_phase_seconds_count{phase=\"",
+                    ph, "\"} ", n, "\n");
+    }
+}
+
+//
+// response header templates
+//
+
+//! @brief Value of the date header, refreshed once per second by the worker's clock
+struct http_date {
+    static constexpr std::string_view placeholder = "Thu, 01 Jan 1970 00:00:00 GMT";
+    static constexpr auto size                    = placeholder.size();
+    JUTIL_INLINE void update() noexcept { format::format(buf, format::hdr_time{}); }
+    char buf[size];
+};
+static thread_local http_date t_date;
+
+#define KEEP_ALIVE_HDRS                                                                            \
+    "connection: keep-alive\r\nkeep-alive: timeout=" BOOST_STRINGIZE(KEEP_ALIVE_SECS) "\r\n"
+
+//! @brief Status line and headers formatted ahead of time; serving one is a memcpy plus patching
+//! in the current date. Unsized templates end in "content-length: " for the caller to complete.
+//! Headers that begin with `KEEP_ALIVE_HDRS` may be served with "connection: close" in their
+//! place.
+struct hdr_tmpl {
+    hdr_tmpl() = default;
+    hdr_tmpl(const std::string_view status, const std::string_view type,
+             const std::string_view hdr = {})
+    {
+        txt.put("HTTP/1.1 ", status, "\r\ncontent-type: ", type, "; charset=UTF-8\r\ndate: ");
+        date_off = txt.size();
+        txt.put<true>(http_date::placeholder, "\r\n", hdr, "content-length: ");
+        find_keep_alive(hdr);
+    }
+    hdr_tmpl(const std::string_view type, const std::string_view hdr, const std::size_t n)
+        : hdr_tmpl{"200 OK", type, hdr}
+    {
+        txt.put<true>(n, "\r\n\r\n");
+        sized = true;
+    }
+
+    //! @brief Response of given status without content
+    [[nodiscard]] static hdr_tmpl bodiless(const std::string_view status,
+                                           const std::string_view hdr)
+    {
+        hdr_tmpl t;
+        t.txt.put("HTTP/1.1 ", status, "\r\ndate: ");
+        t.date_off = t.txt.size();
+        t.txt.put<true>(http_date::placeholder, "\r\n", hdr, "\r\n");
+        t.sized = true;
+        t.find_keep_alive(hdr);
+        return t;
+    }
+
+    static constexpr std::string_view keep_alive_hdrs = KEEP_ALIVE_HDRS;
+
+    buffer txt;
+    std::size_t date_off = 0;
+    std::size_t ka_off   = std::string_view::npos; // of `keep_alive_hdrs`, if the template has them
+    bool sized           = false;
+
+  private:
+    JUTIL_INLINE void find_keep_alive(const std::string_view hdr) noexcept
+    {
+        if (hdr.starts_with(keep_alive_hdrs))
+            ka_off = date_off + http_date::size + 2;
+    }
+};
+
+//! @brief A template as formatted for a connection that's kept open after the response, or else
+//! closed; then its keep-alive headers, if it has them, are replaced by "connection: close"
+struct conn_tmpl {
+    static constexpr std::string_view close_hdr = "connection: close\r\n";
+    const hdr_tmpl &t;
+    bool keep_alive;
+};
+
+template <>
+struct format::formatter<hdr_tmpl> {
+    static char *format(char *d_f, const hdr_tmpl &t) noexcept
+    {
+        memcpy(d_f, t.txt.data(), t.txt.size());
+        memcpy(d_f + t.date_off, t_date.buf, http_date::size);
+        return d_f + t.txt.size();
+    }
+    static std::size_t maxsz(const hdr_tmpl &t) noexcept { return t.txt.size(); }
+};
+
+template <>
+struct format::formatter<conn_tmpl> {
+    static char *format(char *d_f, const conn_tmpl &c) noexcept
+    {
+        const auto &t = c.t;
+        if (c.keep_alive || t.ka_off == std::string_view::npos)
+            return formatter<hdr_tmpl>::format(d_f, t);
+        const auto rest = t.ka_off + hdr_tmpl::keep_alive_hdrs.size();
+        memcpy(d_f, t.txt.data(), t.ka_off);
+        memcpy(d_f + t.date_off, t_date.buf, http_date::size);
+        d_f += t.ka_off;
+        memcpy(d_f, conn_tmpl::close_hdr.data(), conn_tmpl::close_hdr.size());
+        d_f += conn_tmpl::close_hdr.size();
+        memcpy(d_f, t.txt.data() + rest, t.txt.size() - rest);
+        return d_f + t.txt.size() - rest;
+    }
+    static std::size_t maxsz(const conn_tmpl &c) noexcept
+    {
+        return c.t.txt.size() + conn_tmpl::close_hdr.size();
+    }
+};
+
+//! @brief Templates of a keep-alive route whose content has an entity tag and is negotiated by
+//! Accept-Encoding: the full response and the 304 answering a conditional request that already
+//! holds the content
+struct cached_tmpl {
+    cached_tmpl() = default;
+    cached_tmpl(const std::string_view type, const coding c, const std::size_t n,
+                const std::string_view etag, const std::string_view cache_control)
+        : etag{etag}
+    {
+        // A 304 carries the same validators and caching directives as the 200 would
+        buffer hdr;
+        hdr.put(KEEP_ALIVE_HDRS "etag: ", etag, "\r\ncache-control: ", cache_control,
+                "\r\nvary: accept-encoding\r\n");
+        nm = hdr_tmpl::bodiless("304 Not Modified", {hdr.data(), hdr.size()});
+        if (c != coding::identity)
+            hdr.put<true>("content-encoding: ", coding_names[static_cast<std::size_t>(c)], "\r\n");
+        ok = {type, {hdr.data(), hdr.size()}, n};
+    }
+
+    hdr_tmpl ok, nm;
+    std::string_view etag; // quoted
+};
+
+//! @brief Content available in several codings, with templates for each
+struct coded_tmpls {
+    coded_tmpls() = default;
+    //! @param data Content in each coding; empty if not available (except identity)
+    //! @param etags Entity tags of the content in each coding
+    coded_tmpls(const std::string_view type, const std::span<const std::string_view> data,
+                const std::span<const std::string_view> etags,
+                const std::string_view cache_control)
+    {
+        for (auto c = 0_uz; c < ncodings; ++c) {
+            if (c != static_cast<std::size_t>(coding::identity) && data[c].empty())
+                continue;
+            tmpls[c] = {type, static_cast<coding>(c), data[c].size(), etags[c], cache_control};
+            this->data[c]     = data[c];
+            by_size[nbysize++] = static_cast<coding>(c);
+        }
+        sr::stable_sort(std::span{by_size.data(), nbysize}, {},
+                        L(this->data[static_cast<std::size_t>(x)].size(), this));
+    }
+
+    //! @brief Smallest of the acceptable codings; identity if none of them is available
+    [[nodiscard]] JUTIL_INLINE coding pick(const coding_set acc) const noexcept
+    {
+        for (const auto c : std::span{by_size.data(), nbysize})
+            if (acc >> static_cast<unsigned>(c) & 1)
+                return c;
+        return coding::identity;
+    }
+
+    std::array<cached_tmpl, ncodings> tmpls;
+    std::array<std::string_view, ncodings> data;
+    std::array<coding, ncodings> by_size; // available codings, smallest content first
+    std::size_t nbysize = 0;
+};
+
+//! @brief Templates of every route; built by `init_tmpls` before the workers start
+static struct {
+    std::array<coded_tmpls, res::names.size()> res;
+    std::array<hdr_tmpl, g_routes.size()> not_allowed;
+    hdr_tmpl vocab_ver, search, metrics, not_found, overloaded, rate_limited;
+} g_tmpls;
+
+//! @brief Response turning a connection away as soon as it's accepted; 5xx responses needn't
+//! carry a date, so it's a constant
+constexpr std::string_view g_turned_away = "HTTP/1.1 503 Service Unavailable\r\nretry-after: 1\r\n"
+                                           "connection: close\r\ncontent-length: 0\r\n\r\n";
+
+static void init_tmpls(const unsigned max_age)
+{
+    // Bundled assets only change with the executable; they're revalidated unless told otherwise
+    buffer cc;
+    if (max_age)
+        cc.put("max-age=", max_age);
+    else
+        cc.put("no-cache");
+    for (auto i = 0_uz; i < res::names.size(); ++i)
+        g_tmpls.res[i] = {g_routes[i].type, res::contents[i], res::etags[i],
+                          {cc.data(), cc.size()}};
+    for (auto i = 0_uz; i < g_routes.size(); ++i) {
+        constexpr std::string_view mtds[]{"GET",     "HEAD",    "POST",  "PUT",  "DELETE",
+                                          "CONNECT", "OPTIONS", "TRACE", "PATCH"};
+        buffer hdr;
+        hdr.put("connection: close\r\nallow: ");
+        for (auto m = 0_uz, n = 0_uz; m < std::size(mtds); ++m)
+            if (g_routes[i].on[m] != handler::none)
+                hdr.put<true>(n++ ? ", " : "", mtds[m]);
+        hdr.put<true>("\r\ncontent-length: 0\r\n");
+        g_tmpls.not_allowed[i] =
+            hdr_tmpl::bodiless("405 Method Not Allowed", {hdr.data(), hdr.size()});
+    }
+    g_tmpls.vocab_ver = {"200 OK", route_type("/api/vocabVer"), KEEP_ALIVE_HDRS};
+    g_tmpls.search    = {"200 OK", route_type("/api/search"), KEEP_ALIVE_HDRS};
+    g_tmpls.metrics   = {"200 OK", route_type("/api/metrics"),
+                         KEEP_ALIVE_HDRS "cache-control: no-store\r\n"};
+    g_tmpls.not_found = {"404 Not Found", "text/html", KEEP_ALIVE_HDRS};
+    g_tmpls.overloaded =
+        hdr_tmpl::bodiless("503 Service Unavailable",
+                           "retry-after: 1\r\nconnection: close\r\ncontent-length: 0\r\n");
+    g_tmpls.rate_limited = hdr_tmpl::bodiless(
+        "429 Too Many Requests", KEEP_ALIVE_HDRS "retry-after: 1\r\ncontent-length: 0\r\n");
+}
+
+//! @brief A vocab snapshot along with templates of the routes serving it
+struct vocab_snap {
+    vocab_snap(std::shared_ptr<const detail::vocab> v,
+               std::shared_ptr<const detail::vocab_codings> c)
+        : v{std::move(v)}, c{std::move(c)}
+    {
+        std::array<std::string_view, ncodings> etags;
+        for (auto i = 0_uz; i < ncodings; ++i)
+            etags[i] = {this->c->etags[i].data(), this->c->etags[i].size()};
+        // The vocab may be reloaded at any time, so it's always revalidated
+        tmpls = {route_type("/api/vocab"), this->c->data, etags, "no-cache"};
+    }
+    std::shared_ptr<const detail::vocab> v;
+    std::shared_ptr<const detail::vocab_codings> c; // references `v`
+    coded_tmpls tmpls;
+};
+
+//! @brief Worker's current vocab; replaced (on the worker's own thread) when a reload is published
+static thread_local std::shared_ptr<const vocab_snap> t_vocab;
+
+//! @brief A batch of responses written with a single gathered write: status lines and headers
+//! are formatted into `hdr`, generated bodies into `body`, and static payloads are referenced.
+//! Pieces of the vocab file are sent from the file instead, in between gathered writes.
+struct reply {
+    enum class src : unsigned char { hdr, body, ext, file };
+    struct piece {
+        src s;
+        const char *p; // for src::ext; hdr and body are referenced by offset, as ranges of them
+                       // may span chunks
+        std::size_t off, n; // for src::file, the offset is in the file
+    };
+
+    JUTIL_INLINE void clear() noexcept
+    {
+        hdr.clear();
+        body.clear();
+        pieces.clear();
+        hdr_done = 0;
+        ext_n    = 0;
+        nfile    = 0;
+        vocab.reset();
+    }
+
+    //! @brief Ends the current run of `hdr` and appends an immutable payload after it
+    JUTIL_INLINE void payload(const std::string_view ext)
+    {
+        end_hdr();
+        ext_n += ext.size();
+        if (!ext.empty())
+            pieces.push_back({src::ext, ext.data(), 0, ext.size()});
+    }
+
+    //! @brief Ends the current run of `hdr` and appends [off:off+n) of `body` after it
+    JUTIL_INLINE void payload(const std::size_t off, const std::size_t n)
+    {
+        end_hdr();
+        if (n)
+            pieces.push_back({src::body, nullptr, off, n});
+    }
+
+    //! @brief Ends the current run of `hdr` and appends [off:off+n) of the file of `vocab` after
+    //! it; the file must be open
+    JUTIL_INLINE void payload_file(const std::size_t off, const std::size_t n)
+    {
+        end_hdr();
+        ext_n += n;
+        if (n) {
+            pieces.push_back({src::file, nullptr, off, n});
+            ++nfile;
+        }
+    }
+
+    //! @brief Ends the current run of `hdr`; `pieces` then covers the whole batch
+    JUTIL_INLINE void end_hdr()
+    {
+        if (hdr.size() != hdr_done)
+            pieces.push_back({src::hdr, nullptr, hdr_done, hdr.size() - hdr_done});
+        hdr_done = hdr.size();
+    }
+
+    //! @brief Buffer sequence of the whole batch, which has no file pieces; valid until the next
+    //! modification
+    std::span<ba::const_buffer> buffers()
+    {
+        end_hdr();
+        return buffers(pieces.data(), pieces.data() + pieces.size());
+    }
+    //! @brief Buffer sequence of pieces [f, l), none of which is a file piece
+    std::span<ba::const_buffer> buffers(const piece *f, const piece *const l)
+    {
+        iov.clear();
+        for (; f != l; ++f)
+            if (f->s == src::ext)
+                iov.emplace_back(f->p, f->n);
+            else
+                (f->s == src::body ? body : hdr)
+                    .segments(f->off, f->n, L2(iov.emplace_back(x, y), &));
+        return iov;
+    }
+
+    rope hdr, body;
+    std::shared_ptr<const vocab_snap> vocab; // pinned for the batch, as payloads may reference it
+    std::vector<piece> pieces;
+    std::vector<ba::const_buffer> iov;
+    std::size_t hdr_done = 0;
+    std::size_t ext_n    = 0; // bytes of the immutable payloads, file pieces included
+    std::size_t nfile    = 0; // file pieces
+
+    //! @brief Bytes of the batch
+    [[nodiscard]] JUTIL_INLINE std::size_t size() const noexcept
+    {
+        return hdr.size() + body.size() + ext_n;
+    }
+};
+
+//! @brief Content found for a target; payload is either `ext`, which is immutable and outlives
+//! the write, or (if `ext` is null) whatever was appended to the body buffer
 struct gc_res {
-    const std::string_view &type = STATIC_SV(""), &hdr = STATIC_SV("");
+    gc_res() = default;
+    gc_res(const hdr_tmpl *tmpl, const std::string_view ext = {}) : tmpl{tmpl}, ext{ext} {}
+    gc_res(const coded_tmpls &t, const coding_set acc)
+    {
+        const auto c = static_cast<std::size_t>(t.pick(acc));
+        tmpl         = &t.tmpls[c].ok;
+        ext          = t.data[c];
+        cache        = &t.tmpls[c];
+    }
+
+    const hdr_tmpl *tmpl    = nullptr;
+    std::string_view ext    = {};
+    const cached_tmpl *cache = nullptr; // set if the content has an entity tag
 };
 
 template <auto X>
@@ -44,179 +556,833 @@ template <auto X>
     return X;
 }
 
-[[nodiscard]] JUTIL_INLINE gc_res serve_api(const string &uri, buffer &body) noexcept
+//! @brief Finds parameter of given name in a query string and percent-decodes its value in place
+[[nodiscard]] string query_param(const string qs, const std::string_view name) noexcept
 {
-    using namespace std::string_view_literals;
-    if (uri == "vocabVer") {
-        body.put(std::string_view{"1"});
-        return {STATIC_SV("text/plain")};
-    }
-    if (uri == "vocab") {
-        body.put(std::string_view{g_vocab.buf.get(), g_vocab.nbuf});
-        return {STATIC_SV("text/plain"), STATIC_SV("content-encoding: gzip\r\n")};
+    constexpr auto hexval = [](const char c) {
+        return to_unsigned(c - '0') <= 9                ? c - '0'
+               : to_unsigned((c | 0x20) - 'a') <= 'f' - 'a' ? (c | 0x20) - ('a' - 10)
+                                                          : -1;
+    };
+    for (auto f = qs.p, l = qs.p + qs.n; f != l;) {
+        const auto amp = std::find(f, l, '&');
+        const auto eq  = std::find(f, amp, '=');
+        if (std::string_view{f, eq} != name) {
+            f = amp + (amp != l);
+            continue;
+        }
+        const auto vf = eq + (eq != amp);
+        auto d_f      = vf;
+        for (auto it = vf; it != amp; ++it, ++d_f) {
+            int hi, lo;
+            if (*it == '+')
+                *d_f = ' ';
+            else if (*it == '%' && amp - it >= 3 && (hi = hexval(it[1])) >= 0 &&
+                     (lo = hexval(it[2])) >= 0)
+                *d_f = static_cast<char>(hi << 4 | lo), it += 2;
+            else
+                *d_f = *it;
+        }
+        return {vf, static_cast<std::size_t>(d_f - vf)};
     }
-    return {};
+    return {qs.p, 0};
+}
+
+//! @brief Codings the client accepts the response in
+[[nodiscard]] JUTIL_INLINE coding_set accepted(const message &rq) noexcept
+{
+    return accepted_codings(rq.hdrs.get(known_hdr::accept_encoding));
 }
 
-[[nodiscard]] JUTIL_INLINE gc_res get_content(const string &uri, buffer &body) noexcept
+//! @brief Generates content of a route
+//! @param r Route of the request's path
+//! @param h Handler of the route for the request's method
+//! @param qs Query string of the request's target
+[[nodiscard]] JUTIL_INLINE gc_res get_content(const route &r, const handler h, const string &qs,
+                                              const message &rq, reply &rs) noexcept
 {
-    using namespace std::string_view_literals;
-    if (uri.sv().starts_with("/api/"))
-        return serve_api(uri.substr(5), body);
-    if (const auto idx = find_unrl_idx(res::names, uri); idx < res::names.size()) {
-        body.put(res::contents[idx]);
-        return {get_mimetype(uri), STATIC_SV("content-encoding: gzip\r\n")};
+    const auto &v = *rs.vocab->v;
+    switch (h) {
+    case handler::res:
+        return {g_tmpls.res[r.res], accepted(rq)};
+    case handler::search: {
+        constexpr auto maxlimit = 10000_uz;
+        const auto q            = query_param(qs, "q");
+        const auto l            = query_param(qs, "limit");
+        std::size_t limit       = 100;
+        std::from_chars(l.begin(), l.end(), limit);
+        thread_local std::vector<uint32_t> ids;
+        v.idx.find(q, std::min(limit, maxlimit), ids);
+        for (const auto i : ids)
+            rs.body.put<true>(v.idx.term(i), "\n", v.idx.def(i), "\n");
+        return {&g_tmpls.search};
+    }
+    case handler::vocab_ver:
+        rs.body.put<true>(v.ver);
+        return {&g_tmpls.vocab_ver};
+    case handler::vocab:
+        return {rs.vocab->tmpls, accepted(rq)};
+    case handler::metrics:
+        write_metrics(rs.body);
+        return {&g_tmpls.metrics};
+    default:
+        return {};
     }
-    return {};
 }
 
 constexpr std::string_view nf1 = "<!DOCTYPE html><meta charset=utf-8><title>Error 404 (Not "
                                  "Found)</title><p><b>404</b> Not Found.<p>The resource <code>",
                            nf2 = "</code> was not found.";
 
-struct escaped {
-    escaped(const std::string_view sv) : f{sv.data()}, l{sv.data() + sv.size()} {}
-    constexpr JUTIL_INLINE std::size_t size() const noexcept
-    {
-        return static_cast<std::size_t>(l - f);
+//! @brief Whether a comma-separated list, such as the value of a Connection header, has given
+//! token; tokens are compared case-insensitively
+[[nodiscard]] bool has_token(std::string_view lst, const std::string_view tok) noexcept
+{
+    for (;;) {
+        const auto f = lst.find_first_not_of(" \t,");
+        if (f == std::string_view::npos)
+            return false;
+        lst.remove_prefix(f);
+        const auto l = std::min(lst.find(','), lst.size());
+        const auto t = lst.substr(0, lst.find_last_not_of(" \t", l - 1) + 1);
+        if (sr::equal(t, tok, {}, L(x | 0x20), L(x | 0x20)))
+            return true;
+        lst.remove_prefix(l);
     }
-    const char *const f, *const l;
-};
+}
 
-template <class It>
-It escape(const char *f, const char *const l, It d_f) noexcept
+//! @brief Whether the connection may be reused after serving given request
+[[nodiscard]] JUTIL_INLINE bool wants_keep_alive(const message &rq) noexcept
 {
-#define ESC_copystr(S) std::copy_n(S, sizeof(S) - 1, d_f)
-    for (; f != l; ++f) {
-        switch (const char c = *f) {
-        case '<':
-            d_f = ESC_copystr("&lt;");
-            break;
-        case '>':
-            d_f = ESC_copystr("&gt;");
-            break;
-        case '&':
-            d_f = ESC_copystr("&amp;");
-            break;
-        default:
-            *d_f++ = c;
-        }
-    }
-    return d_f;
+    const auto con = rq.hdrs.get(known_hdr::connection);
+    return !has_token(con, "close") &&
+           (rq.strt.ver == version::http11 || has_token(con, "keep-alive"));
 }
 
-template <>
-struct format::formatter<escaped> {
-    static char *format(char *d_f, const escaped &e) noexcept { return escape(e.f, e.l, d_f); }
-    static std::size_t maxsz(const escaped &e) noexcept { return e.size() * 5; }
-};
+//! @brief Whether value of an If-None-Match header lists given entity tag; weak comparison is
+//! used, as mandated for If-None-Match: https://www.rfc-editor.org/rfc/rfc9110#section-13.1.2
+[[nodiscard]] bool etag_listed(std::string_view inm, const std::string_view etag) noexcept
+{
+    for (;;) {
+        const auto f = inm.find_first_not_of(" \t,");
+        if (f == std::string_view::npos)
+            return false;
+        inm.remove_prefix(f);
+        if (inm[0] == '*')
+            return true;
+        if (inm.starts_with("W/"))
+            inm.remove_prefix(2);
+        if (inm.empty())
+            return false;
+        const auto l   = inm[0] == '"' ? inm.find('"', 1) : inm.find(',');
+        const auto tag = inm.substr(0, l + (l != std::string_view::npos && inm[0] == '"'));
+        if (tag == etag)
+            return true;
+        inm.remove_prefix(tag.size());
+    }
+}
 
-//! @brief Writes a response message serving a given request message
+//! @brief Appends a response message serving a given request message
 //! @param rq Request message to serve
-//! @param rs Response message for given request
-void serve(const message &rq, buffer &rs, buffer &body)
+//! @param rs Responses so far; the response is appended
+//! @param ri Set to the index of the route of the request's path; `g_routes.size()` if none
+//! @return Whether the connection should be kept open
+bool serve(const message &rq, reply &rs, std::size_t &ri)
 {
+    ri = g_routes.size();
     if (rq.strt.mtd == method::err)
         goto badreq;
     if (rq.strt.ver == version::err)
         goto badver;
 
-    switch (rq.strt.mtd) {
-    case method::GET: {
-        if (const auto [type, hdr] = get_content(rq.strt.tgt, body); !type.empty()) {
-            rs.put("HTTP/1.1 200 OK\r\nconnection: keep-alive\r\ncontent-type: ", type,
-                   "; charset=UTF-8\r\ndate: ", format::hdr_time{}, //
-                   "\r\ncontent-length: ", body.size(),
-                   "\r\nkeep-alive: timeout=" BOOST_STRINGIZE(KEEP_ALIVE_SECS), //
-                   "\r\n", hdr,                                                 //
-                   "\r\n", std::string_view{body.data(), body.size()});
-        } else {
-            const escaped res = rq.strt.tgt.sv().substr(0, 100);
-            rs.put("HTTP/1.1 404 Not Found\r\n"
-                   "content-type: text/html; charset=UTF-8\r\n"
-                   "content-length:",
-                   nf1.size() + nf2.size() + res.size(), //
-                   "\r\ndate: ", format::hdr_time{},     //
-                   "\r\n\r\n", nf1, res, nf2);
+    {
+        const auto &tgt = rq.strt.tgt;
+        const auto qm   = std::find(tgt.p, tgt.p + tgt.n, '?');
+        const string path{tgt.p, static_cast<std::size_t>(qm - tgt.p)};
+        const auto ka = wants_keep_alive(rq);
+        ri            = g_router.find(path);
+        if (ri == g_routes.size()) {
+            const format::escaped res = tgt.sv().substr(0, 100);
+            rs.hdr.put<true>(conn_tmpl{g_tmpls.not_found, ka},
+                             nf1.size() + nf2.size() + res.size(), "\r\n\r\n", nf1, res, nf2);
+            return ka;
         }
-        return;
-    }
-    default:;
+        const auto &r = g_routes[ri];
+        const auto h  = r.on[static_cast<std::size_t>(rq.strt.mtd)];
+        if (h == handler::none) {
+            rs.hdr.put<true>(g_tmpls.not_allowed[ri]);
+            return false;
+        }
+
+        const auto b0 = rs.body.size();
+        const auto [tmpl, ext, cache] =
+            get_content(r, h, tgt.substr(std::min(path.n + 1, tgt.n)), rq, rs);
+        if (cache && etag_listed(rq.hdrs.get(known_hdr::if_none_match), cache->etag)) {
+            rs.hdr.put<true>(conn_tmpl{cache->nm, ka});
+            return ka;
+        }
+        if (tmpl->sized)
+            rs.hdr.put<true>(conn_tmpl{*tmpl, ka});
+        else
+            rs.hdr.put<true>(conn_tmpl{*tmpl, ka}, rs.body.size() - b0, "\r\n\r\n");
+        if (const auto &v = *rs.vocab->v; ext.data() == v.buf && v.fd != -1)
+            rs.payload_file(0, ext.size());
+        else if (ext.data())
+            rs.payload(ext);
+        else
+            rs.payload(b0, rs.body.size() - b0);
+        return ka;
     }
 badreq:
-    rs.put("400 Bad Request\r\n\r\n\r\n");
-    return;
+    rs.hdr.put<true>(
+        "HTTP/1.1 400 Bad Request\r\nconnection: close\r\ncontent-length: 0\r\n\r\n");
+    return false;
 badver:
-    rs.put("505 HTTP Version Not Supported\r\n\r\n\r\n");
+    rs.hdr.put<true>("HTTP/1.1 505 HTTP Version Not Supported\r\nconnection: close\r\n"
+                     "content-length: 0\r\n\r\n");
+    return false;
 }
 
-DBGSTMNT(static int ncon = 0;)
+//! @brief Appends a response to a request the parser rejected, after which the connection is
+//! closed
+void reject(const request_parser::result r, reply &rs)
+{
+    if (r == request_parser::result::too_large)
+        rs.hdr.put<true>("HTTP/1.1 413 Content Too Large\r\nconnection: close\r\n"
+                         "content-length: 0\r\n\r\n");
+    else if (r == request_parser::result::header_too_large)
+        rs.hdr.put<true>("HTTP/1.1 431 Request Header Fields Too Large\r\nconnection: close\r\n"
+                         "content-length: 0\r\n\r\n");
+    else
+        rs.hdr.put<true>(
+            "HTTP/1.1 400 Bad Request\r\nconnection: close\r\ncontent-length: 0\r\n\r\n");
+}
 
 inline constexpr auto coro_hdlr = ba::experimental::as_tuple(ba::use_awaitable);
-ba::awaitable<void> handle_connection(ba::ip::tcp::socket soc_)
+
+//! @brief Writes a batch holding pieces of the vocab file: runs of other pieces with gathered
+//! writes, flagged MSG_MORE when a file piece follows so that a header shares packets with its
+//! body, and file pieces with sendfile(2), from the page cache without passing through user space
+//!
+//! Writes only as much as the socket takes without blocking; the connection's coroutine awaits
+//! writability in between. A coroutine of its own would have its frame allocated for every batch.
+struct file_writer {
+    explicit file_writer(reply &rs) noexcept : rs{rs} {}
+
+    //! @brief Prepares to write the batch; fails if it can't be sent from the file
+    [[nodiscard]] boost::system::error_code begin(ba::ip::tcp::socket &soc)
+    {
+#ifdef __linux__
+        // Responses after the last payload of the batch are still in the current run of `hdr`
+        rs.end_hdr();
+        f = rs.pieces.data(), l = f + rs.pieces.size();
+        // A file rewritten in place no longer matches the entity tags and lengths of the
+        // snapshot; the connection is closed rather than sent other bytes under them
+        if (!rs.vocab->v->file_unchanged())
+            return {ESTALE, boost::system::system_category()};
+        boost::system::error_code ec;
+        soc.non_blocking(true, ec);
+        return ec;
+#else
+        static_cast<void>(soc);
+        return ba::error::operation_not_supported;
+#endif
+    }
+
+    //! @brief Writes as much of the rest of the batch as the socket takes
+    //! @return `ba::error::would_block` if the socket must become writable for the rest to be
+    //! written, success once all of it has been
+    [[nodiscard]] boost::system::error_code send(ba::ip::tcp::socket &soc)
+    {
+#ifdef __linux__
+        boost::system::error_code ec;
+        while (f != l) {
+            if (f->s == reply::src::file) {
+                for (auto off = static_cast<off_t>(f->off + done),
+                          e   = static_cast<off_t>(f->off + f->n);
+                     off < e;) {
+                    const auto r = sendfile(soc.native_handle(), rs.vocab->v->fd, &off,
+                                            static_cast<std::size_t>(e - off));
+                    if (r > 0) {
+                        total += static_cast<std::size_t>(r);
+                        done += static_cast<std::size_t>(r);
+                        continue;
+                    }
+                    if (r == -1 && errno == EAGAIN)
+                        return ba::error::would_block;
+                    // Failed, or the file was truncated
+                    return r ? boost::system::error_code{errno, boost::system::system_category()}
+                             : ba::error::eof;
+                }
+                ++f, done = 0;
+                continue;
+            }
+            if (iov.empty()) {
+                fl  = std::find_if(f, l, L(x.s == reply::src::file));
+                iov = rs.buffers(f, fl);
+            }
+            while (!iov.empty()) {
+                auto n = soc.send(iov, fl != l ? MSG_MORE : 0, ec);
+                total += n;
+                if (ec)
+                    return ec;
+                for (; n; iov = iov.subspan(!iov.front().size())) {
+                    const auto m = std::min(n, iov.front().size());
+                    iov.front() += m;
+                    n -= m;
+                }
+            }
+            f = fl;
+        }
+        return ec;
+#else
+        static_cast<void>(soc);
+        return ba::error::operation_not_supported;
+#endif
+    }
+
+    reply &rs;
+    const reply::piece *f = nullptr, *l = nullptr;
+    const reply::piece *fl = nullptr; // end of the run of gathered pieces being written
+    std::span<ba::const_buffer> iov;  // rest of the run
+    std::size_t done  = 0;            // of the file piece at `f`
+    std::size_t total = 0;            // bytes written
+};
+
+//! @brief Read buffers of the worker, for its connections to draw from
+static thread_local read_pool *t_reads;
+
+//! @brief Tick of the timer wheels, i.e. how coarse their timers are
+inline constexpr sc::milliseconds g_wheel_tick{100};
+
+//! @brief Current tick of the timer wheels
+[[nodiscard]] static uint64_t wheel_now() noexcept
 {
-    using namespace ba::experimental::awaitable_operators;
+    return static_cast<uint64_t>(sc::steady_clock::now().time_since_epoch() / g_wheel_tick);
+}
 
-    DBGEXPR(const int id_ = ncon++);
-    DBGEXPR(printf("con#%d: accepted\n", id_));
+//! @brief Timer wheel of the worker, holding the idle timers of its connections
+static thread_local timer_wheel *t_wheel;
 
-    // Read into buffer
-    ba::steady_timer to_{soc_.get_executor(), sc::seconds(KEEP_ALIVE_SECS)};
-    std::vector<char> rq_;
-    const auto res =
-        co_await(ba::async_read_until(soc_, ba::dynamic_buffer(rq_), "\r\n\r\n", coro_hdlr) ||
-                 to_.async_wait(coro_hdlr));
-    if (res.index() == 1)
-        co_return; // timeout
+//! @brief Limits of a worker, its share of those of the server; 0 for none
+struct admission {
+    admission(const server_config &cfg, const unsigned nworkers)
+        : max_conns{(cfg.max_conns + nworkers - 1) / nworkers},
+          max_inflight{(cfg.max_inflight + nworkers - 1) / nworkers}
+    {
+        // Each worker gives a client the full rate: a client's connections may land on any
+        // workers, and one with a single connection stays on one. A client spreading many
+        // connections over the workers may thus exceed the rate, by up to as many times as there
+        // are workers.
+        if (cfg.rate_limit > 0)
+            limiter.emplace(cfg.rate_limit, cfg.burst);
+    }
 
-    // Read request
-    const auto [rdec, rdn] = std::get<0>(res);
-    if (rdec) {
-        if (rdec != ba::error::eof)
-            g_log.print(std::string_view{rdec.category().name()}, ": ", rdec.value(), ": ",
-                        std::string_view{rdec.message()});
-        co_return;
+    //! @brief Whether the worker has as many connections open as it may
+    [[nodiscard]] JUTIL_INLINE bool full() const noexcept
+    {
+        return max_conns && conns >= max_conns;
     }
 
-    // Handle request & build response
+    //! @brief Most connections turned away that a worker drains at once; more are closed at once
+    static constexpr unsigned max_draining = 256;
+
+    unsigned max_conns, max_inflight;
+    unsigned conns    = 0;    // open
+    unsigned draining = 0;    // turned away, being drained
+    std::size_t inflight = 0; // requests served whose responses are yet to be written
+    std::optional<rate_limiter> limiter;
+};
+static thread_local admission *t_adm;
+
+//! @brief Key of the client at an address: an IPv4 address, or the /64 prefix of an IPv6 one
+[[nodiscard]] static uint64_t client_key(const ba::ip::address &a) noexcept
+{
+    if (a.is_v4())
+        return a.to_v4().to_uint();
+    const auto b = a.to_v6().to_bytes();
+    uint64_t k;
+    memcpy(&k, b.data(), sizeof(k));
+    return k | uint64_t{1} << 63; // apart from every IPv4 address
+}
+
+//! @brief Connection coroutines of a worker parked between connections
+//!
+//! A coroutine whose connection has ended parks here, keeping its frame, read buffer, parser and
+//! reply buffers, and is handed the next connection the worker accepts; in steady state,
+//! connections thus cost no allocations. Coroutines are only spawned while more connections are
+//! open than there are parked, and those beyond `max_parked` exit once their connections end.
+struct conn_pool {
+    struct parked {
+        ba::ip::tcp::socket *soc; // to move the next connection into
+        ba::steady_timer *wake;   // waited on, never expiring; cancelled to hand over a connection
+    };
+
+    //! @brief Hands a connection to a parked coroutine, if there's one
+    [[nodiscard]] JUTIL_INLINE bool hand_over(ba::ip::tcp::socket &soc)
+    {
+        if (idle.empty())
+            return false;
+        const auto p = idle.back();
+        idle.pop_back();
+        *p.soc = std::move(soc);
+        p.wake->cancel();
+        return true;
+    }
+
+    std::vector<parked> idle; // reserved for `max_parked`
+    std::size_t max_parked = 0;
+};
+static thread_local conn_pool *t_conns;
+
+DBGSTMNT(static std::atomic_int ncon = 0;)
+
+//! @brief Handles connections of the worker one after the other, starting with given one
+ba::awaitable<void> handle_connections(ba::ip::tcp::socket soc_)
+{
+    using result = request_parser::result;
+
+    auto &m_     = g_metrics.local();
+    auto &adm_   = *t_adm;
+    auto &conns_ = *t_conns;
+
+    // State reused by every request on a connection, and by every connection
+    struct idle_timer : timer_wheel::entry {
+        ba::ip::tcp::socket *soc;
+        bool fired = false;
+    } to_;
+    to_.soc  = &soc_;
+    to_.fire = [](timer_wheel::entry &e) {
+        // The pending read is cancelled, and finds the connection timed out
+        auto &t = static_cast<idle_timer &>(e);
+        t.fired = true;
+        boost::system::error_code ec;
+        t.soc->cancel(ec);
+    };
+    auto &wheel_     = *t_wheel;
+    auto &reads_     = *t_reads;
+    const auto slot_ = reads_.acquire();
+    DEFER[&] { reads_.release(slot_); };
+    rbuf rq_ = slot_ == read_pool::npos ? rbuf{} : rbuf{reads_.mem(slot_)};
+    request_parser prs_;
     message msg_;
-    parse_header(rq_.data(), rq_.data() + (rdn - 4), msg_);
-    DBGEXPR(printf("vvv con#%d: received message with the header:\n", id_));
-    DBGEXPR(print_header(msg_));
-    DBGEXPR(printf("^^^\n"));
-    // determining message length (after CRLFCRLF):
-    // https://www.w3.org/Protocols/rfc2616/rfc2616-sec4.html#sec4.4
-    buffer rs_;
-    buffer rs_body_;
-    serve(msg_, rs_, rs_body_);
-    rq_.clear();
+    reply rs_;
+    const bool logged_ = g_alog.enabled();
+    std::vector<alog::request> recs_; // of the batch, completed once it's written
+    ba::steady_timer wake_{soc_.get_executor()};
+
+    // State of the current connection
+    DBGEXPR(int id_);
+    uint32_t peer_       = 0;
+    uint64_t client_     = 0;
+    std::size_t nflight_ = 0; // of the batch, counted in `adm_.inflight`
 
-    // Write response
-    const auto [wrec, _] =
-        co_await ba::async_write(soc_, ba::buffer(rs_.data(), rs_.size()), coro_hdlr);
-    if (wrec) {
-        g_log.print(std::string_view{wrec.category().name()}, ": ", wrec.value(), ": ",
-                    std::string_view{wrec.message()});
-        co_return;
+    // Times spent on the current request (or batch), in ticks; the clock is read as few times as
+    // possible, each reading ending one phase and beginning the next
+    uint64_t t_first = 0, t_parse = 0, t_last = 0;
+    const auto parse = [&](const std::size_t off) {
+        const auto t0 = ticks::now();
+        const auto r  = prs_.parse(rq_.data() + off, rq_.data() + rq_.size(), msg_);
+        t_last        = ticks::now();
+        t_parse += t_last - t0;
+        return r;
+    };
+    // Phases are timed once, in ns, for both the metrics and the access log
+    const auto record = [&](const uint64_t t0, const std::array<uint64_t, alog::write> &ns,
+                            const uint16_t st, const std::size_t n0) {
+        // Only routes are interned: other paths are the client's to choose, without bound
+        const auto &tgt = msg_.strt.tgt;
+        const auto rt   = tgt.p ? g_router.find({tgt.p, static_cast<std::size_t>(
+                                                           std::find(tgt.p, tgt.p + tgt.n, '?') -
+                                                           tgt.p)})
+                                : g_routes.size();
+        auto &r         = recs_.emplace_back();
+        r.h             = {alog::kind::request, 0, sizeof(alog::request)};
+        r.target        = rt < g_routes.size() ? g_alog.intern(rt, g_routes[rt].path) : 0;
+        r.time          = g_alog.unix_ns(t0);
+        r.peer          = peer_;
+        r.bytes         = static_cast<uint32_t>(std::min<std::size_t>(rs_.size() - n0, UINT32_MAX));
+        for (auto p = 0_uz; p < ns.size(); ++p)
+            r.lat[p] = alog::access_log::lat_ns(ns[p]);
+        r.status        = st;
+        r.method        = static_cast<uint8_t>(msg_.strt.mtd);
+    };
+
+    for (;;) {
+        DBGEXPR(id_ = ncon++);
+        DBGEXPR(printf("con#%d: accepted\n", id_));
+        m_.active.add();
+        ++adm_.conns;
+        const auto addr = [&] {
+            boost::system::error_code ec;
+            const auto ep = soc_.remote_endpoint(ec);
+            return ec ? ba::ip::address{} : ep.address();
+        }();
+        peer_   = addr.is_v4() ? addr.to_v4().to_uint() : 0u;
+        client_ = client_key(addr);
+
+        for (bool keep_alive = true; keep_alive;) {
+            // Read into buffer until it holds at least one complete request; it doesn't if the
+            // connection ends first
+            to_.fired = false;
+            wheel_.arm(to_, sc::seconds{KEEP_ALIVE_SECS} / g_wheel_tick);
+            t_first = ticks::now(), t_parse = 0;
+            auto r  = result::incomplete;
+            while ((r = parse(0)) == result::incomplete) {
+                // Bytes read as the timer fired are parsed, but no more are waited for
+                if (to_.fired) {
+                    m_.timeouts.add();
+                    break;
+                }
+                const auto sp  = rq_.prepare(rbuf::defcap / 2);
+                const auto [rdec, rdn] =
+                    co_await soc_.async_read_some(ba::buffer(sp.data(), sp.size()), coro_hdlr);
+                if (rdec == ba::error::operation_aborted && to_.fired) {
+                    m_.timeouts.add();
+                    break;
+                }
+                if (rdec) {
+                    if (rdec != ba::error::eof)
+                        g_log.print(std::string_view{rdec.category().name()}, ": ", rdec.value(),
+                                    ": ", std::string_view{rdec.message()});
+                    break;
+                }
+                rq_.commit(rdn);
+                // Waiting for the request to begin isn't part of reading it
+                if (rq_.size() == rdn)
+                    t_first = ticks::now(), t_parse = 0;
+            }
+            to_.cancel();
+            if (r == result::incomplete)
+                break;
+
+            // Handle every complete request in the buffer; pipelined responses are batched
+            rs_.clear();
+            rs_.vocab       = t_vocab;
+            std::size_t off = 0;
+            do {
+                const auto h0 = rs_.hdr.size(), n0 = rs_.size();
+                const auto t0 = t_last;
+                auto ri       = g_routes.size();
+                if (r != result::complete) {
+                    msg_.strt  = {{nullptr, 0}, version::err, method::err};
+                    keep_alive = false;
+                    m_.parse_errors.add();
+                    reject(r, rs_);
+                } else if (adm_.max_inflight && adm_.inflight - nflight_ >= adm_.max_inflight) {
+                    // Shed: as many responses as the worker may hold are waiting to be written for
+                    // other connections. This batch's own don't count: its pipeline is bounded by
+                    // the read buffer, and a lone client would otherwise be shed by its own depth.
+                    rs_.hdr.put<true>(g_tmpls.overloaded);
+                    keep_alive = false;
+                    m_.rejected[static_cast<std::size_t>(rejection::inflight)].add();
+                } else if (adm_.limiter && !adm_.limiter->admit(client_, t0)) {
+                    keep_alive = wants_keep_alive(msg_);
+                    rs_.hdr.put<true>(conn_tmpl{g_tmpls.rate_limited, keep_alive});
+                    m_.rejected[static_cast<std::size_t>(rejection::rate)].add();
+                } else {
+                    DBGEXPR(printf("vvv con#%d: received message with the header:\n", id_));
+                    DBGEXPR(print_header(msg_));
+                    DBGEXPR(printf("^^^\n"));
+                    keep_alive = serve(msg_, rs_, ri);
+                    ++adm_.inflight, ++nflight_;
+                }
+                const auto t1 = ticks::now();
+                const auto sl = h0 + 9; // past "HTTP/1.1 "
+                const auto st = static_cast<uint16_t>((rs_.hdr[sl] - '0') * 100 +
+                                                      (rs_.hdr[sl + 1] - '0') * 10 +
+                                                      (rs_.hdr[sl + 2] - '0'));
+                m_.requests[ri][status_idx(st)].add();
+                const std::array<uint64_t, alog::write> ns{
+                    ticks::to_ns(t0 - t_parse - t_first), ticks::to_ns(t_parse),
+                    ticks::to_ns(t1 - t0)};
+                for (auto p = 0_uz; p < ns.size(); ++p)
+                    m_.lat[p].add(ns[p]);
+                if (logged_)
+                    record(t0, ns, st, n0);
+                t_first = t1, t_parse = 0;
+                if (!keep_alive)
+                    break;
+                off += prs_.size();
+                prs_.reset();
+            } while ((r = parse(off)) != result::incomplete);
+            rq_.consume(off);
+
+            // Write responses
+            const auto tw          = t_first;
+            std::tuple<boost::system::error_code, std::size_t> wr;
+            if (rs_.nfile) {
+                file_writer fw{rs_};
+                auto ec = fw.begin(soc_);
+                while (!ec && (ec = fw.send(soc_)) == ba::error::would_block)
+                    std::tie(ec) = co_await soc_.async_wait(ba::socket_base::wait_write, coro_hdlr);
+                wr = {ec, fw.total};
+            } else
+                wr = co_await ba::async_write(soc_, rs_.buffers(), coro_hdlr);
+            const auto [wrec, wrn] = wr;
+            const auto dw          = ticks::to_ns(ticks::now() - tw);
+            adm_.inflight -= nflight_;
+            nflight_ = 0;
+            rs_.vocab.reset();
+            m_.bytes_out.add(wrn);
+            m_.lat[alog::write].add(dw);
+            if (logged_) {
+                const auto w = alog::access_log::lat_ns(dw);
+                for (auto &rec : recs_)
+                    rec.lat[alog::write] = w;
+                g_alog.push(recs_);
+                recs_.clear();
+            }
+            if (wrec) {
+                g_log.print(std::string_view{wrec.category().name()}, ": ", wrec.value(), ": ",
+                            std::string_view{wrec.message()});
+                break;
+            }
+
+            DBGEXPR(printf("con#%d: write end\n", id_));
+        }
+
+        // The connection has ended; its state is reset for the next one, a buffer that has outgrown
+        // its initial memory giving up the excess
+        boost::system::error_code ec;
+        soc_.close(ec);
+        m_.active.sub();
+        --adm_.conns;
+        if (rq_.cap_ > rbuf::defcap)
+            rq_ = slot_ == read_pool::npos ? rbuf{} : rbuf{reads_.mem(slot_)};
+        else
+            rq_.consume(rq_.size());
+        prs_.reset();
+        recs_.clear();
+
+        if (conns_.idle.size() >= conns_.max_parked)
+            co_return;
+        conns_.idle.push_back({&soc_, &wake_});
+        wake_.expires_at(sc::steady_clock::time_point::max());
+        co_await wake_.async_wait(coro_hdlr);
     }
+}
+
+//! @brief Connection turned away, whose request is read and dropped after the 503 until the
+//! client closes, for a second at most: closing with the request unread, or arriving after,
+//! would reset the connection, possibly before the client has read the response
+struct turned_away : timer_wheel::entry {
+    turned_away(ba::ip::tcp::socket s, admission &adm) : soc{std::move(s)}, adm{adm}
+    {
+        ++adm.draining;
+        fire = [](timer_wheel::entry &e) {
+            boost::system::error_code ec;
+            static_cast<turned_away &>(e).soc.cancel(ec);
+        };
+        t_wheel->arm(*this, sc::seconds{1} / g_wheel_tick);
+    }
+    ~turned_away() { --adm.draining; }
+    NO_COPY_MOVE(turned_away);
+
+    ba::ip::tcp::socket soc;
+    admission &adm;
+    std::array<char, 512> discard;
+};
+
+static void drain(std::unique_ptr<turned_away> c)
+{
+    auto &r = *c;
+    r.soc.async_receive(ba::buffer(r.discard), [c = std::move(c)](auto ec, std::size_t) mutable {
+        // Until the client closes, the deadline passes or the read fails
+        if (!ec)
+            drain(std::move(c));
+    });
+}
 
-    DBGEXPR(printf("con#%d: write end\n", id_));
+//! @brief Starts handling a connection accepted for a worker, on a parked coroutine if there's
+//! one, unless the worker is full; then the connection is answered with a constant 503 and
+//! drained, without a coroutine or buffers being given to it
+//!
+//! Runs on the thread of the worker.
+static void start_connection(ba::io_context &ioc, admission &adm, conn_pool &conns,
+                             ba::ip::tcp::socket soc)
+{
+    auto &m = g_metrics.local();
+    m.accepted.add();
+    if (!adm.full()) [[likely]] {
+        if (!conns.hand_over(soc))
+            ba::co_spawn(ioc, handle_connections(std::move(soc)), ba::detached);
+        return;
+    }
+    m.rejected[static_cast<std::size_t>(rejection::connections)].add();
+    boost::system::error_code ec;
+    soc.non_blocking(true, ec);
+    soc.send(ba::buffer(g_turned_away), 0, ec);
+    soc.shutdown(ba::socket_base::shutdown_send, ec);
+    if (!ec && adm.draining < admission::max_draining)
+        drain(std::make_unique<turned_away>(std::move(soc), adm));
+    else
+        soc.close(ec);
 }
 
-void accept_loop(auto &ioc, auto &ac, auto &soc)
+void accept_loop(auto &ioc, admission &adm, conn_pool &conns, auto &ac, auto &soc)
 {
     ac.async_accept(soc, [&](auto ec) {
         if (!ec)
-            ba::co_spawn(ioc, handle_connection(std::move(soc)), ba::detached);
-        accept_loop(ioc, ac, soc);
+            start_connection(ioc, adm, conns, std::move(soc));
+        accept_loop(ioc, adm, conns, ac, soc);
     });
 }
 
-void run_server(const ba::ip::tcp::endpoint &ep)
-{
+//! @brief An event loop pinned to one thread; connections never migrate between workers
+struct worker {
+    //! @param nreads Number of read buffers in the pool of the worker, and of connection
+    //! coroutines it keeps parked
+    void run(std::shared_ptr<const vocab_snap> vocab, const std::size_t nreads)
+    {
+#ifdef VOCABSERV_COUNT_ALLOCS
+        alloc_count::enable();
+#endif
+        read_pool reads{nreads};
+        conns.max_parked = nreads;
+        conns.idle.reserve(nreads);
+        t_reads = &reads;
+        t_conns = &conns;
+        t_wheel = &wheel;
+        t_adm   = &*adm;
+        t_vocab = std::move(vocab);
+        tick();
+        sweep();
+        const auto g = ba::make_work_guard(ioc);
+        ioc.run();
+    }
+
+    //! @brief Refreshes this thread's date stamp on every second boundary
+    void tick()
+    {
+        t_date.update();
+        const auto now = sc::system_clock::now();
+        clk.expires_after(sc::floor<sc::seconds>(now) + sc::seconds{1} - now);
+        clk.async_wait([this](const auto ec) {
+            if (!ec)
+                tick();
+        });
+    }
+
+    //! @brief Fires the timers of the wheel that are due, on every tick boundary; idle
+    //! connections are thus closed in bulk, with one wakeup per tick however many there are
+    void sweep()
+    {
+        const auto t = wheel_now();
+        wheel.advance(t);
+        sweeper.expires_at(sc::steady_clock::time_point{(t + 1) * g_wheel_tick});
+        sweeper.async_wait([this](const auto ec) {
+            if (!ec)
+                sweep();
+        });
+    }
+
+    timer_wheel wheel{wheel_now()}; // outlives the connections, destroyed along with the ioc
     ba::io_context ioc{1};
-    ba::ip::tcp::acceptor ac{ioc, ep};
+    ba::ip::tcp::acceptor ac{ioc};
     ba::ip::tcp::socket soc{ioc};
-    accept_loop(ioc, ac, soc);
-    ioc.run();
+    ba::steady_timer clk{ioc}, sweeper{ioc};
+    conn_pool conns;
+    std::optional<admission> adm; // set before the worker starts, as accepts may already check it
+};
+
+#ifdef SO_REUSEPORT
+using reuse_port = ba::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+
+//! @brief Every worker listens on its own acceptor; the kernel load-balances connections
+static void listen_all(worker *const ws, const unsigned n, const ba::ip::tcp::endpoint &ep)
+{
+    for (auto &w : std::span{ws, n}) {
+        w.ac.open(ep.protocol());
+        w.ac.set_option(ba::socket_base::reuse_address{true});
+        w.ac.set_option(reuse_port{true});
+        w.ac.bind(ep);
+        w.ac.listen();
+        accept_loop(w.ioc, *w.adm, w.conns, w.ac, w.soc);
+    }
+}
+#else
+//! @brief Without SO_REUSEPORT the first worker accepts on behalf of all in round-robin order
+static void rr_accept_loop(worker *const ws, const unsigned n, unsigned i)
+{
+    ws[0].ac.async_accept(ws[i].ioc, [=](auto ec, ba::ip::tcp::socket soc) {
+        // The connection is started on the thread of its worker, which owns the parked coroutines
+        if (!ec)
+            ba::post(ws[i].ioc, [w = &ws[i], soc = std::move(soc)]() mutable {
+                start_connection(w->ioc, *w->adm, w->conns, std::move(soc));
+            });
+        rr_accept_loop(ws, n, (i + 1) % n);
+    });
+}
+static void listen_all(worker *const ws, const unsigned n, const ba::ip::tcp::endpoint &ep)
+{
+    ws[0].ac = ba::ip::tcp::acceptor{ws[0].ioc, ep};
+    rr_accept_loop(ws, n, 0);
+}
+#endif
+
+//! @brief Snapshot of a vocab in the codings it has at hand, i.e. without compressing it
+[[nodiscard]] static std::shared_ptr<const vocab_snap>
+uncompressed_snap(std::shared_ptr<const detail::vocab> v)
+{
+    auto c = std::make_shared<const detail::vocab_codings>(*v);
+    return std::make_shared<const vocab_snap>(std::move(v), std::move(c));
+}
+
+//! @brief Hands a snapshot to each worker; a worker drops its old one once in-flight batches
+//! referencing it have been written
+static void publish(worker *const ws, const unsigned n, std::shared_ptr<const vocab_snap> snap)
+{
+    for (auto &w : std::span{ws, n})
+        ba::post(w.ioc, [snap] { t_vocab = snap; });
+}
+
+//! @brief Compresses the vocab being served, then reloads it whenever its file changes
+//!
+//! As compressing at maximum level takes a while, every version is first published as it is
+//! loaded, and then again once the rest of its codings are ready.
+static void reload_loop(const server_config &cfg, worker *const ws, const unsigned n,
+                        std::shared_ptr<const detail::vocab> v)
+{
+    detail::vocab_watch w{cfg.vocab_path, cfg.load != detail::load_mode::read};
+    for (;;) {
+        auto c = std::make_shared<detail::vocab_codings>(*v);
+        c->compress_missing();
+        publish(ws, n, std::make_shared<const vocab_snap>(v, std::move(c)));
+
+        for (;;) {
+            if (!w.wait())
+                return;
+            auto nv = std::make_shared<detail::vocab>();
+            if (nv->init(cfg.vocab_path, cfg.load, cfg.sendfile)) {
+                v = std::move(nv);
+                break;
+            }
+            g_log.print("couldn't reload vocab file \"", std::string_view{cfg.vocab_path}, "\"");
+        }
+        g_log.print("loaded vocab file \"", std::string_view{cfg.vocab_path}, "\" as version ",
+                    v->ver);
+        publish(ws, n, uncompressed_snap(v));
+    }
+}
+
+void run_server(const ba::ip::tcp::endpoint &ep, const server_config &cfg,
+                std::shared_ptr<const detail::vocab> vocab)
+{
+    init_tmpls(cfg.max_age);
+    static_cast<void>(ticks::per_us()); // calibrated before it's needed by requests
+    const auto n    = std::max(cfg.nworkers, 1u);
+    const auto ws   = std::make_unique<worker[]>(n);
+    const auto snap = uncompressed_snap(vocab);
+    for (auto &w : std::span{ws.get(), n})
+        w.adm.emplace(cfg, n);
+    listen_all(ws.get(), n, ep);
+
+    // Worker 0 runs on the calling thread
+    std::vector<std::jthread> ts;
+    ts.reserve(n);
+    for (auto &w : std::span{ws.get() + 1, n - 1})
+        ts.emplace_back([&w, snap, &cfg] { w.run(snap, cfg.read_bufs); });
+    ts.emplace_back([&, vocab = std::move(vocab)] { reload_loop(cfg, ws.get(), n, vocab); });
+    ws[0].run(snap, cfg.read_bufs);
 }
@@ -1,3 +1,28 @@
+#pragma once
+
 #include <boost/asio/ip/tcp.hpp>
+#include <memory>
+
+#include "vocabserv.h"
+
+struct server_config {
+    unsigned nworkers;      // number of worker threads, each running its own io_context
+    const char *vocab_path; // watched for changes; reloaded without dropping connections
+    detail::load_mode load;
+    unsigned max_age;       // cache lifetime of the bundled assets, in seconds; 0 to revalidate
+    unsigned read_bufs;     // per worker, pooled for connections
+    bool sendfile;          // whether the vocab file is sent with sendfile(2) when served as-is
+
+    // Admission control; 0 for no limit
+    unsigned max_conns;    // open connections, over all workers; more are answered with 503
+    unsigned max_inflight; // responses of other connections yet to be written, over all workers
+    double rate_limit;     // requests per second per client address, on each worker; more get 429
+    double burst;          // requests a client address may make at once, on each worker
+};
 
-void run_server(const boost::asio::ip::tcp::endpoint &endpoint);
\ No newline at end of file
+//! @brief Serves on given endpoint using a pool of single-threaded event loops
+//! @param endpoint Address to listen on; each worker binds it with SO_REUSEPORT
+//! @param cfg Server configuration
+//! @param vocab Initial vocab, loaded from `cfg.vocab_path`
+void run_server(const boost::asio::ip::tcp::endpoint &endpoint, const server_config &cfg,
+                std::shared_ptr<const detail::vocab> vocab);
\ No newline at end of file
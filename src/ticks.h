@@ -0,0 +1,54 @@
+#pragma once
+
+#include <chrono>
+#include <stdint.h>
+#include <thread>
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+#include "jutil.h"
+
+//! @brief Cheap monotonic clock for timing short intervals on the request path: the TSC where
+//! there is one (a few ns to read, against ~20 for `steady_clock`), else `steady_clock` in ns
+namespace ticks
+{
+[[nodiscard]] JUTIL_INLINE uint64_t now() noexcept
+{
+#if defined(__x86_64__) || defined(_M_X64)
+    return __rdtsc();
+#else
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                     std::chrono::steady_clock::now().time_since_epoch())
+                                     .count());
+#endif
+}
+
+//! @brief Ticks per microsecond; measured against `steady_clock` on first call, which takes
+//! 20 ms
+[[nodiscard]] inline double per_us()
+{
+    static const double r = [] {
+#if defined(__x86_64__) || defined(_M_X64)
+        namespace sc  = std::chrono;
+        const auto s0 = sc::steady_clock::now();
+        const auto t0 = now();
+        std::this_thread::sleep_for(sc::milliseconds{20});
+        const auto s1 = sc::steady_clock::now();
+        const auto t1 = now();
+        return static_cast<double>(t1 - t0) /
+               static_cast<double>(sc::duration_cast<sc::nanoseconds>(s1 - s0).count()) * 1e3;
+#else
+        return 1e3;
+#endif
+    }();
+    return r;
+}
+
+//! @brief Ticks as ns
+[[nodiscard]] JUTIL_INLINE uint64_t to_ns(const uint64_t t)
+{
+    static const double ns_per_tick = 1e3 / per_us();
+    return static_cast<uint64_t>(static_cast<double>(t) * ns_per_tick);
+}
+} // namespace ticks
@@ -0,0 +1,55 @@
+#include "timer_wheel.h"
+
+#include <assert.h>
+
+timer_wheel::~timer_wheel()
+{
+    for (auto &l : slots_)
+        for (auto &s : l)
+            while (s.next != &s)
+                s.next->cancel();
+}
+
+void timer_wheel::splice(entry &slot, entry &to) noexcept
+{
+    if (slot.next == &slot)
+        return;
+    to.next       = slot.next;
+    to.prev       = slot.prev;
+    to.next->prev = &to;
+    to.prev->next = &to;
+    slot.prev = slot.next = &slot;
+}
+
+void timer_wheel::advance(const uint64_t to)
+{
+    for (; now_ < to;) {
+        const auto t = now_;
+        // On a boundary of a level's slots the slot coming up is cascaded down, from the highest
+        // level whose boundary it is, so that entries cascaded more than one level get there too
+        auto top = 0u;
+        while (top + 1 < nlevels && !(t & ((uint64_t{1} << (level_bits * (top + 1))) - 1)))
+            ++top;
+        for (auto l = top; l; --l) {
+            entry pending;
+            splice(slots_[l][t >> (level_bits * l) & (nslots - 1)], pending);
+            while (pending.next && pending.next != &pending) {
+                auto &e = *pending.next;
+                e.cancel();
+                link(e);
+            }
+        }
+
+        // The slot is taken out before anything fires, and the wheel is past its tick, so that
+        // entries (re-)armed by `fire` land in a slot still to come, even when it's this one
+        entry due;
+        splice(slots_[0][t & (nslots - 1)], due);
+        ++now_;
+        while (due.next && due.next != &due) {
+            auto &e = *due.next;
+            assert(e.due == t);
+            e.cancel();
+            e.fire(e);
+        }
+    }
+}
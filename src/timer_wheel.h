@@ -0,0 +1,103 @@
+#pragma once
+
+#include <array>
+#include <stdint.h>
+
+#include "jutil.h"
+
+//! @brief Hierarchical timer wheel: coarse timers that are armed, re-armed and cancelled in O(1)
+//!
+//! Time is counted in ticks, whose length is up to the owner, who advances the wheel as they pass.
+//! Timers due within 64 ticks are kept in a slot per tick; later ones in slots spanning 64 times
+//! as many ticks per level, and are moved down a level as their slot comes up. Timers are
+//! intrusive: an entry is linked into the list of its slot, and unlinked when it fires, is
+//! cancelled or is destroyed. Not thread-safe; each worker has its own.
+//!
+//! Usage example:
+//!
+//!     timer_wheel w{0};
+//!     timer_wheel::entry e;
+//!     e.fire = [](timer_wheel::entry &e) { ...; };
+//!     w.arm(e, 50);   // fires once 50 more ticks have passed
+//!     w.arm(e, 50);   // pushed back
+//!     e.cancel();
+//!     w.advance(now); // fires what's due up to tick `now`
+//!
+class timer_wheel
+{
+  public:
+    static constexpr unsigned level_bits = 6, nslots = 1u << level_bits, nlevels = 4;
+    //! @brief Longest delay; longer ones are cut to it
+    static constexpr uint64_t max_delay = (uint64_t{1} << (level_bits * nlevels)) - 1;
+
+    struct entry {
+        entry() = default;
+        ~entry() { cancel(); }
+        NO_COPY_MOVE(entry);
+
+        [[nodiscard]] JUTIL_INLINE bool armed() const noexcept { return next != nullptr; }
+        JUTIL_INLINE void cancel() noexcept
+        {
+            if (next) {
+                prev->next = next;
+                next->prev = prev;
+                prev = next = nullptr;
+            }
+        }
+
+        void (*fire)(entry &) = nullptr; // called once due, the entry being no longer armed
+
+      private:
+        friend class timer_wheel;
+        entry *prev = nullptr, *next = nullptr; // in the list of a slot; null if not armed
+        uint64_t due = 0;                       // tick
+    };
+
+    //! @param now Current tick
+    explicit timer_wheel(const uint64_t now) noexcept : now_{now}
+    {
+        for (auto &l : slots_)
+            for (auto &s : l)
+                s.prev = s.next = &s;
+    }
+    //! @brief Disarms the entries still armed, which may outlive the wheel
+    ~timer_wheel();
+    NO_COPY_MOVE(timer_wheel);
+
+    //! @brief Arms an entry, or re-arms it if it is, to fire once `delay` more ticks have passed
+    JUTIL_INLINE void arm(entry &e, const uint64_t delay) noexcept
+    {
+        e.cancel();
+        e.due = now_ + (delay < max_delay ? delay : max_delay);
+        link(e);
+    }
+
+    //! @brief Fires every entry due before given tick, in order of ticks
+    //!
+    //! An entry may be re-armed or cancelled, and others armed or cancelled, while it fires.
+    void advance(uint64_t to);
+
+    //! @brief Next tick to be processed by `advance`
+    [[nodiscard]] JUTIL_INLINE uint64_t now() const noexcept { return now_; }
+
+  private:
+    //! @brief Inserts an entry into the slot of its due tick at the lowest level that reaches it
+    JUTIL_INLINE void link(entry &e) noexcept
+    {
+        const auto d = e.due - now_;
+        auto l       = 0u;
+        while (l + 1 < nlevels && d >> (level_bits * (l + 1)))
+            ++l;
+        auto &head = slots_[l][e.due >> (level_bits * l) & (nslots - 1)];
+        e.prev     = &head;
+        e.next     = head.next;
+        head.next->prev = &e;
+        head.next       = &e;
+    }
+
+    //! @brief Moves the entries of a slot into `to` (empty), leaving the slot empty
+    static void splice(entry &slot, entry &to) noexcept;
+
+    std::array<std::array<entry, nslots>, nlevels> slots_; // list heads
+    uint64_t now_;
+};
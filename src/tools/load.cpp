@@ -0,0 +1,596 @@
+#include <boost/asio.hpp>
+#include <boost/asio/experimental/as_tuple.hpp>
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <random>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "../jutil.h"
+#include "../message.h"
+
+#include "../lmacro_begin.h"
+
+//! @brief HTTP load generator for vocabserv
+//!
+//! Usage example:
+//!
+//!     vocabserv-load --connections=64 --pipeline=4 --rate=50000 --duration=30 localhost 8080
+//!
+//! Without `--rate`, every connection sends its next request as soon as a response arrives
+//! (closed loop). With it, requests are sent on a fixed schedule regardless of how the server
+//! keeps up (open loop), and latency is measured from when a request was due rather than from
+//! when it could be sent. Closed-loop latencies are corrected after the fact instead: taking the
+//! mean interval between requests of a pipeline slot as the one it would have kept up, a response
+//! that took k such intervals also stands for the k - 1 requests it held up. That's an estimate;
+//! as it adds values below the ones they stand in for, its lower percentiles can come out below
+//! the measured ones.
+//! Requests due during the warmup count towards neither latencies, throughput nor errors.
+
+namespace sc = std::chrono;
+namespace ba = boost::asio;
+
+using tcp = ba::ip::tcp;
+
+namespace
+{
+inline constexpr auto coro_hdlr = ba::experimental::as_tuple(ba::use_awaitable);
+
+//
+// configuration
+//
+
+struct url {
+    std::string path;
+    double weight;
+};
+
+//! @brief Static assets, the vocab and searches of a few sizes, weighted like a page load
+//! followed by typing into the search box
+const std::vector<url> default_mix{
+    {"/", 1},
+    {"/index.js", 1},
+    {"/index.css", 1},
+    {"/api/vocab", 1},
+    {"/api/search?q=a", 2},
+    {"/api/search?q=ka", 2},
+    {"/api/search?q=koira", 2},
+    {"/api/search?q=xyzzy&limit=10", 1},
+};
+
+struct config {
+    std::string host, port;
+    unsigned connections = 16, threads = 1, pipeline = 1;
+    bool keep_alive      = true;
+    double rate          = 0; // requests per second in total; 0 for closed loop
+    sc::nanoseconds duration{sc::seconds{10}}, warmup{sc::seconds{1}};
+    std::string encoding = "gzip, deflate, br, zstd";
+    std::vector<url> mix;
+};
+
+//! @brief Removes option `--<name>=<value>` from argv
+//! @return Pointer to the value, or nullptr if option wasn't given
+const char *take_opt(int &argc, char **argv, const std::string_view name) noexcept
+{
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+        if (arg.size() > name.size() + 3 && arg.starts_with("--") &&
+            arg.substr(2, name.size()) == name && arg[name.size() + 2] == '=') {
+            std::copy(argv + i + 1, argv + argc, argv + i);
+            --argc;
+            return arg.data() + name.size() + 3;
+        }
+    }
+    return nullptr;
+}
+
+//
+// results
+//
+
+//! @brief Log-linear histogram of durations in ns with 128 buckets per power of two, i.e. within
+//! 0.8% of the recorded value; values below 256 ns are kept exactly
+struct histogram {
+    static constexpr unsigned sub_bits = 7, subs = 1u << sub_bits, max_exp = 42;
+    static constexpr auto nbuckets     = 2 * subs + (max_exp - sub_bits - 1) * subs;
+
+    [[nodiscard]] static constexpr std::size_t bucket(const uint64_t ns) noexcept
+    {
+        const auto e = static_cast<unsigned>(std::bit_width(ns));
+        if (e <= sub_bits + 1)
+            return static_cast<std::size_t>(ns);
+        if (e > max_exp)
+            return nbuckets - 1;
+        return 2 * subs + (e - sub_bits - 2) * subs + (ns >> (e - sub_bits - 1) & (subs - 1));
+    }
+    //! @brief Lowest value of a bucket
+    [[nodiscard]] static constexpr uint64_t lower_ns(const std::size_t b) noexcept
+    {
+        if (b < 2 * subs)
+            return b;
+        const auto e = static_cast<unsigned>((b - 2 * subs) / subs) + sub_bits + 2;
+        return (subs + (b - 2 * subs) % subs) << (e - sub_bits - 1);
+    }
+
+    void add(const uint64_t ns, const uint64_t n = 1) noexcept
+    {
+        counts[bucket(ns)] += n;
+        total += n;
+        max = std::max(max, ns);
+        sum += static_cast<double>(ns) * static_cast<double>(n);
+    }
+    //! @brief Adds a value along with those of the requests it delayed, had they been sent every
+    //! `interval` ns
+    void add_corrected(const uint64_t ns, const uint64_t interval) noexcept
+    {
+        add(ns);
+        if (interval)
+            for (auto v = ns; v > interval;)
+                add(v -= interval);
+    }
+    void merge(const histogram &o) noexcept
+    {
+        for (auto i = 0_uz; i < nbuckets; ++i)
+            counts[i] += o.counts[i];
+        total += o.total;
+        max = std::max(max, o.max);
+        sum += o.sum;
+    }
+
+    [[nodiscard]] uint64_t quantile(const double q) const noexcept
+    {
+        const auto rank = static_cast<uint64_t>(q * static_cast<double>(total));
+        uint64_t n      = 0;
+        for (auto i = 0_uz; i < nbuckets; ++i)
+            if ((n += counts[i]) > rank)
+                return std::min(lower_ns(i), max);
+        return max;
+    }
+    [[nodiscard]] double mean() const noexcept
+    {
+        return total ? sum / static_cast<double>(total) : 0;
+    }
+
+    std::vector<uint64_t> counts = std::vector<uint64_t>(nbuckets);
+    uint64_t total = 0, max = 0;
+    double sum = 0;
+};
+static_assert(histogram::bucket(255) == 255 && histogram::bucket(256) == 256 &&
+              histogram::bucket(258) == 257 && histogram::lower_ns(257) == 258 &&
+              histogram::lower_ns(histogram::bucket(1'000'000)) <= 1'000'000);
+
+//! @brief What the connections of a thread measured
+struct stats {
+    histogram lat;     // from when requests were sent
+    histogram lat_due; // from when requests were due, in open loop
+    std::vector<uint64_t> by_url;
+    uint64_t errors = 0, bytes = 0, connects = 0;
+};
+
+//
+// connections
+//
+
+using clock = sc::steady_clock;
+
+struct pending {
+    clock::time_point due, sent;
+    std::size_t url;
+};
+
+//! @brief State of a thread, shared by its connections
+struct worker {
+    worker(const config &cfg, const std::vector<std::string> &reqs,
+           const std::vector<tcp::endpoint> &eps, const clock::time_point start)
+        : cfg{cfg}, reqs{reqs}, eps{eps}, start{start}, end{start + cfg.duration}
+    {
+        st.by_url.resize(cfg.mix.size());
+    }
+
+    const config &cfg;
+    const std::vector<std::string> &reqs; // by url
+    const std::vector<tcp::endpoint> &eps;
+    clock::time_point start, end;
+    ba::io_context ioc{1};
+    stats st;
+};
+
+//! @brief Size of the response at the front of a buffer, or 0 if it isn't complete yet
+//! @param status Set to the status of the response
+std::size_t response_size(const std::string_view b, unsigned &status) noexcept
+{
+    const auto hl = b.find("\r\n\r\n");
+    if (hl == std::string_view::npos)
+        return 0;
+    const auto hdr = b.substr(0, hl + 2);
+    status         = 0;
+    std::from_chars(hdr.data() + std::min<std::size_t>(9, hdr.size()), hdr.data() + hdr.size(),
+                    status);
+    std::size_t len = 0;
+    for (auto f = hdr.find("\r\n"); f != std::string_view::npos; f = hdr.find("\r\n", f + 2)) {
+        constexpr std::string_view cl = "content-length:";
+        const auto line               = hdr.substr(f + 2, cl.size());
+        if (sr::equal(line, cl, {}, L(x | 0x20))) {
+            auto p = hdr.data() + f + 2 + cl.size();
+            while (*p == ' ')
+                ++p;
+            std::from_chars(p, hdr.data() + hdr.size(), len);
+            break;
+        }
+    }
+    const auto n = hl + 4 + len;
+    return b.size() >= n ? n : 0;
+}
+
+//! @brief Picks requests by the weights of the URL mix
+struct picker {
+    picker(const config &cfg, const unsigned seed)
+        : rng{seed}, dist{[&] {
+              std::vector<double> ws;
+              for (const auto &u : cfg.mix)
+                  ws.push_back(u.weight);
+              return std::discrete_distribution<std::size_t>{ws.begin(), ws.end()};
+          }()}
+    {
+    }
+    std::size_t operator()() { return dist(rng); }
+
+    std::mt19937 rng;
+    std::discrete_distribution<std::size_t> dist;
+};
+
+//! @brief Time at which the k-th request of a connection is due, in open loop; connections are
+//! staggered so requests are spread evenly
+[[nodiscard]] clock::time_point due_at(const worker &w, const unsigned con, const uint64_t k)
+{
+    const auto period = 1e9 / w.cfg.rate; // between requests of all connections
+    return w.start + sc::nanoseconds{static_cast<int64_t>(
+                         period * (static_cast<double>(k) * w.cfg.connections + con))};
+}
+
+//! @brief Whether a request due at given time is past the warmup, and so counts in the results
+[[nodiscard]] bool measured(const worker &w, const clock::time_point due) noexcept
+{
+    return due >= w.start + w.cfg.warmup;
+}
+
+//! @param size Bytes of the response, headers included
+void record(worker &w, const pending &p, const clock::time_point now, const unsigned status,
+            const std::size_t size)
+{
+    if (!measured(w, p.due))
+        return;
+    w.st.bytes += size;
+    if (status < 200 || status >= 400)
+        ++w.st.errors;
+    ++w.st.by_url[p.url];
+    w.st.lat.add(static_cast<uint64_t>((now - p.sent).count()));
+    if (w.cfg.rate)
+        w.st.lat_due.add(static_cast<uint64_t>((now - p.due).count()));
+}
+
+//! @brief A kept-alive connection: a writer sends requests, up to `pipeline` of them unanswered,
+//! and a reader matches the responses to them
+struct conn {
+    explicit conn(worker &w) : soc{w.ioc}, room{w.ioc}, sent{w.ioc} {}
+
+    //! @brief Suspends until given timer is cancelled, which signals a change of state
+    static ba::awaitable<void> wait(ba::steady_timer &t)
+    {
+        t.expires_at(clock::time_point::max());
+        co_await t.async_wait(coro_hdlr);
+    }
+
+    tcp::socket soc;
+    ba::steady_timer room; // signalled to the writer when a response arrives
+    ba::steady_timer sent; // signalled to the reader when requests are sent, or the writer ends
+    std::deque<pending> inflight;
+    bool done = false, writing = true;
+};
+
+//! @brief Writer of a connection; waits for each request to be due and for room in the pipeline
+//! @param k Requests sent so far by the connection's client
+ba::awaitable<void> write_requests(worker &w, conn &c, picker &pick, const unsigned con,
+                                   uint64_t &k)
+{
+    std::string out;
+    while (!c.done) {
+        const auto due = w.cfg.rate ? due_at(w, con, k) : clock::now();
+        if (due >= w.end)
+            break;
+        if (w.cfg.rate && due > clock::now()) {
+            ba::steady_timer t{w.ioc, due};
+            co_await t.async_wait(coro_hdlr);
+        }
+        while (!c.done && c.inflight.size() >= w.cfg.pipeline)
+            co_await conn::wait(c.room);
+        if (c.done)
+            break;
+
+        // Closed loop fills the pipeline in one write; open loop sends each request when due
+        out.clear();
+        const auto now = clock::now();
+        do {
+            const auto u = pick();
+            c.inflight.push_back({w.cfg.rate ? due_at(w, con, k) : now, now, u});
+            out += w.reqs[u];
+            ++k;
+        } while (!w.cfg.rate && c.inflight.size() < w.cfg.pipeline);
+        c.sent.cancel();
+        if (const auto [ec, _] = co_await ba::async_write(c.soc, ba::buffer(out), coro_hdlr); ec)
+            break;
+    }
+}
+
+//! @brief Keeps a connection open, reconnecting whenever the server closes it
+ba::awaitable<void> run_keep_alive(worker &w, const unsigned con)
+{
+    picker pick{w.cfg, con};
+    // Until the next request would be due after the end
+    for (uint64_t k = 0; (w.cfg.rate ? due_at(w, con, k) : clock::now()) < w.end;) {
+        conn c{w};
+        if (const auto [ec, _] = co_await ba::async_connect(c.soc, w.eps, coro_hdlr); ec) {
+            w.st.errors += measured(w, clock::now());
+            ba::steady_timer t{w.ioc, sc::milliseconds{100}};
+            co_await t.async_wait(coro_hdlr);
+            continue;
+        }
+        ++w.st.connects;
+        c.soc.set_option(tcp::no_delay{true});
+        ba::co_spawn(w.ioc, write_requests(w, c, pick, con, k), [&c](std::exception_ptr) {
+            c.writing = false;
+            c.sent.cancel();
+        });
+
+        rbuf rb;
+        while (c.writing || !c.inflight.empty()) {
+            if (c.inflight.empty()) {
+                co_await conn::wait(c.sent);
+                continue;
+            }
+            const auto sp      = rb.prepare(rbuf::defcap);
+            const auto [ec, n] = co_await c.soc.async_read_some(ba::buffer(sp.data(), sp.size()),
+                                                               coro_hdlr);
+            if (ec)
+                break;
+            rb.commit(n);
+            const auto now = clock::now();
+            for (unsigned status; const auto sz = response_size({rb.data(), rb.size()}, status);) {
+                if (c.inflight.empty()) {
+                    ++w.st.errors; // a response to no request
+                    break;
+                }
+                record(w, c.inflight.front(), now, status, sz);
+                c.inflight.pop_front();
+                rb.consume(sz);
+            }
+            c.room.cancel();
+        }
+
+        // The connection was closed early; what's unanswered counts as failed
+        w.st.errors += static_cast<uint64_t>(sr::count_if(c.inflight, L(measured(w, x.due), &)));
+        c.done = true;
+        c.room.cancel();
+        boost::system::error_code ec;
+        c.soc.close(ec);
+        while (c.writing)
+            co_await conn::wait(c.sent);
+    }
+}
+
+//! @brief Sends each request on a connection of its own, closed by the server after responding
+ba::awaitable<void> run_close(worker &w, const unsigned con)
+{
+    picker pick{w.cfg, con};
+    rbuf rb;
+    for (uint64_t k = 0;; ++k) {
+        const auto due = w.cfg.rate ? due_at(w, con, k) : clock::now();
+        if (due >= w.end)
+            break;
+        if (w.cfg.rate && due > clock::now()) {
+            ba::steady_timer t{w.ioc, due};
+            co_await t.async_wait(coro_hdlr);
+        }
+        const auto u    = pick();
+        const auto sent = clock::now();
+        tcp::socket soc{w.ioc};
+        if (const auto [ec, _] = co_await ba::async_connect(soc, w.eps, coro_hdlr); ec) {
+            w.st.errors += measured(w, due);
+            continue;
+        }
+        ++w.st.connects;
+        soc.set_option(tcp::no_delay{true});
+        if (const auto [ec, _] = co_await ba::async_write(soc, ba::buffer(w.reqs[u]), coro_hdlr);
+            ec) {
+            w.st.errors += measured(w, due);
+            continue;
+        }
+        rb.consume(rb.size());
+        unsigned status = 0;
+        std::size_t sz  = 0;
+        while (!sz) {
+            const auto sp      = rb.prepare(rbuf::defcap);
+            const auto [ec, n] = co_await soc.async_read_some(ba::buffer(sp.data(), sp.size()),
+                                                             coro_hdlr);
+            if (ec)
+                break;
+            rb.commit(n);
+            sz = response_size({rb.data(), rb.size()}, status);
+        }
+        if (sz)
+            record(w, {due, sent, u}, clock::now(), status, sz);
+        else if (measured(w, due))
+            ++w.st.errors;
+    }
+}
+
+//
+// report
+//
+
+void print_report(const config &cfg, const stats &st)
+{
+    const auto secs = sc::duration<double>{cfg.duration - cfg.warmup}.count();
+    uint64_t n      = 0;
+    for (const auto c : st.by_url)
+        n += c;
+    printf("%u connections on %u threads, %s, pipeline depth %u, ", cfg.connections, cfg.threads,
+           cfg.keep_alive ? "keep-alive" : "one request each", cfg.pipeline);
+    if (cfg.rate)
+        printf("open loop at %.0f requests/s\n", cfg.rate);
+    else
+        printf("closed loop\n");
+    printf("%llu requests in %.1f s: %.1f requests/s, %.2f MiB/s, %llu errors, %llu connects\n",
+           static_cast<unsigned long long>(n), secs, static_cast<double>(n) / secs,
+           static_cast<double>(st.bytes) / secs / (1 << 20),
+           static_cast<unsigned long long>(st.errors),
+           static_cast<unsigned long long>(st.connects));
+
+    // The coordinated-omission-corrected column: measured from when requests were due (open loop),
+    // or with the requests stalled behind slow ones added back (closed loop, at the interval each
+    // pipeline slot sent requests at on average; a slot waits for its response, so a response
+    // without a stall spans about one interval)
+    histogram corrected;
+    if (cfg.rate)
+        corrected = st.lat_due;
+    else {
+        const auto interval =
+            n ? static_cast<uint64_t>(secs * 1e9 * cfg.connections * cfg.pipeline /
+                                      static_cast<double>(n))
+              : 0;
+        for (auto i = 0_uz; i < histogram::nbuckets; ++i)
+            for (auto c = st.lat.counts[i]; c--;)
+                corrected.add_corrected(histogram::lower_ns(i), interval);
+        corrected.max = st.lat.max; // replayed from the buckets' lowest values
+        printf("closed-loop correction estimated at a send interval of %.1f us per pipeline slot\n",
+               static_cast<double>(interval) / 1e3);
+    }
+    printf("\nlatency        measured     corrected\n");
+    constexpr std::pair<const char *, double> qs[]{
+        {"p50", .5}, {"p90", .9}, {"p99", .99}, {"p99.9", .999}, {"p99.99", .9999}};
+    for (const auto &[name, q] : qs)
+        printf("%-8s %11.1f us %10.1f us\n", name, static_cast<double>(st.lat.quantile(q)) / 1e3,
+               static_cast<double>(corrected.quantile(q)) / 1e3);
+    printf("%-8s %11.1f us %10.1f us\n", "max", static_cast<double>(st.lat.max) / 1e3,
+           static_cast<double>(corrected.max) / 1e3);
+    printf("%-8s %11.1f us %10.1f us\n", "mean", st.lat.mean() / 1e3, corrected.mean() / 1e3);
+
+    printf("\nrequests  url\n");
+    for (auto i = 0_uz; i < cfg.mix.size(); ++i)
+        printf("%8llu  %s\n", static_cast<unsigned long long>(st.by_url[i]),
+               cfg.mix[i].path.c_str());
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    config cfg;
+    const auto num = [&](const char *name, auto &x) {
+        const auto v = take_opt(argc, argv, name);
+        if (v && std::from_chars(v, v + strlen(v), x).ec != std::errc{}) {
+            fprintf(stderr, "invalid --%s\n", name);
+            exit(1);
+        }
+        return v != nullptr;
+    };
+    const auto secs = [&](const char *name, sc::nanoseconds &x) {
+        double s = 0;
+        if (num(name, s))
+            x = sc::nanoseconds{static_cast<int64_t>(s * 1e9)};
+    };
+    num("connections", cfg.connections);
+    num("threads", cfg.threads);
+    num("pipeline", cfg.pipeline);
+    num("rate", cfg.rate);
+    unsigned keep_alive = 1;
+    num("keep-alive", keep_alive);
+    cfg.keep_alive = keep_alive;
+    secs("duration", cfg.duration);
+    secs("warmup", cfg.warmup);
+    if (const auto v = take_opt(argc, argv, "encoding"))
+        cfg.encoding = v;
+    while (const auto v = take_opt(argc, argv, "url")) {
+        // <path>[@<weight>]
+        const std::string_view s = v;
+        const auto at            = s.rfind('@');
+        double weight            = 1;
+        if (at != std::string_view::npos)
+            std::from_chars(s.data() + at + 1, s.data() + s.size(), weight);
+        cfg.mix.push_back({std::string{s.substr(0, at)}, weight});
+    }
+    if (argc != 3 || !cfg.connections || !cfg.threads || !cfg.pipeline || cfg.rate < 0 ||
+        cfg.warmup >= cfg.duration) {
+        fprintf(stderr,
+                "usage: %s [--connections=<n>] [--threads=<n>] [--pipeline=<depth>] "
+                "[--keep-alive=<0|1>] [--rate=<requests/s>] [--duration=<secs>] "
+                "[--warmup=<secs>] [--encoding=<accept-encoding>] [--url=<path>[@<weight>]]... "
+                "<host> <port>\n",
+                argv[0]);
+        return 1;
+    }
+    cfg.host = argv[1];
+    cfg.port = argv[2];
+    if (cfg.mix.empty())
+        cfg.mix = default_mix;
+    if (!cfg.keep_alive)
+        cfg.pipeline = 1;
+    cfg.threads = std::min(cfg.threads, cfg.connections);
+
+    std::vector<std::string> reqs;
+    for (const auto &u : cfg.mix)
+        reqs.push_back("GET " + u.path + " HTTP/1.1\r\nhost: " + cfg.host + ":" + cfg.port +
+                       "\r\naccept-encoding: " + cfg.encoding + "\r\n" +
+                       (cfg.keep_alive ? "" : "connection: close\r\n") + "\r\n");
+
+    std::vector<tcp::endpoint> eps;
+    {
+        ba::io_context ioc;
+        tcp::resolver res{ioc};
+        boost::system::error_code ec;
+        for (const auto &e : res.resolve(cfg.host, cfg.port, ec))
+            eps.push_back(e.endpoint());
+        if (ec || eps.empty()) {
+            fprintf(stderr, "couldn't resolve %s:%s\n", cfg.host.c_str(), cfg.port.c_str());
+            return 1;
+        }
+    }
+
+    // Connections are spread over the threads, each running its own io_context
+    const auto start = clock::now() + sc::milliseconds{10};
+    std::vector<std::unique_ptr<worker>> ws;
+    for (auto t = 0u; t < cfg.threads; ++t)
+        ws.push_back(std::make_unique<worker>(cfg, reqs, eps, start));
+    for (auto c = 0u; c < cfg.connections; ++c) {
+        auto &w = *ws[c % cfg.threads];
+        ba::co_spawn(w.ioc, cfg.keep_alive ? run_keep_alive(w, c) : run_close(w, c),
+                     ba::detached);
+    }
+    {
+        std::vector<std::jthread> ts;
+        for (auto &w : ws)
+            ts.emplace_back([&w] { w->ioc.run(); });
+    }
+
+    stats st;
+    st.by_url.resize(cfg.mix.size());
+    for (const auto &w : ws) {
+        st.lat.merge(w->st.lat);
+        st.lat_due.merge(w->st.lat_due);
+        for (auto i = 0_uz; i < st.by_url.size(); ++i)
+            st.by_url[i] += w->st.by_url[i];
+        st.errors += w->st.errors;
+        st.bytes += w->st.bytes;
+        st.connects += w->st.connects;
+    }
+    print_report(cfg, st);
+}
+
+#include "../lmacro_end.h"
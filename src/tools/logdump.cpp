@@ -0,0 +1,245 @@
+#include <algorithm>
+#include <deque>
+#include <magic_enum.hpp>
+#include <map>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <string_view>
+#include <time.h>
+#include <unordered_map>
+#include <vector>
+
+#include "../access_log.h"
+#include "../message.h"
+
+#include "../lmacro_begin.h"
+
+//! @brief Decoder of the binary access log (<n>.alog files in the log directory)
+//!
+//! Usage example:
+//!
+//!     vocabserv-logdump [--csv | --stats] logs/1.alog logs/3.alog
+//!
+
+namespace
+{
+enum class output { text, csv, stats };
+
+struct decoded {
+    alog::request r;
+    const std::string *target;
+};
+
+// Ids are only unique within a run of the server, so a request is resolved against the latest
+// definition of its target when it's read
+std::deque<std::string> g_names;
+std::unordered_map<uint32_t, const std::string *> g_targets;
+const std::string g_unknown = "-";
+
+//! @brief Appends the records of a file to rs
+bool read_file(const char *const path, std::vector<decoded> &rs)
+{
+    const auto f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "couldn't open \"%s\"\n", path);
+        return false;
+    }
+    std::vector<char> d;
+    char chunk[1 << 16];
+    for (std::size_t n; (n = fread(chunk, 1, sizeof(chunk), f));)
+        d.insert(d.end(), chunk, chunk + n);
+    fclose(f);
+
+    alog::file_header fh{};
+    if (d.size() >= sizeof(fh))
+        memcpy(&fh, d.data(), sizeof(fh));
+    if (memcmp(fh.magic, alog::magic, sizeof(fh.magic)) || fh.version != alog::version ||
+        fh.request_size != sizeof(alog::request)) {
+        fprintf(stderr, "\"%s\" isn't an access log of this version\n", path);
+        return false;
+    }
+    for (auto i = sizeof(fh); i < d.size();) {
+        alog::head h;
+        if (d.size() - i < sizeof(h))
+            break;
+        memcpy(&h, &d[i], sizeof(h));
+        if (h.size < sizeof(h) || d.size() - i < h.size)
+            break; // truncated by a crash or a failed write
+        if (h.k == alog::kind::target && h.size >= sizeof(alog::target)) {
+            alog::target t;
+            memcpy(&t, &d[i], sizeof(t));
+            std::string_view s{&d[i + sizeof(t)], h.size - sizeof(t)};
+            g_targets[t.id] = &g_names.emplace_back(s.substr(0, s.find('\0')));
+        } else if (h.k == alog::kind::request && h.size == sizeof(alog::request)) {
+            decoded r;
+            memcpy(&r.r, &d[i], sizeof(r.r));
+            const auto it = g_targets.find(r.r.target);
+            r.target      = it == g_targets.end() ? &g_unknown : it->second;
+            rs.push_back(r);
+        }
+        i += h.size;
+    }
+    return true;
+}
+
+std::string_view method_name(const uint8_t m)
+{
+    const auto n = magic_enum::enum_name(static_cast<method>(m));
+    return n.empty() ? "?" : n;
+}
+
+//! @brief ISO 8601 UTC time with ns
+void print_time(FILE *const f, const int64_t ns)
+{
+    const time_t s = static_cast<time_t>(ns / 1'000'000'000);
+    tm t;
+    gmtime_r(&s, &t);
+    char buf[32];
+    strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", &t);
+    fprintf(f, "%s.%09lldZ", buf, static_cast<long long>(ns % 1'000'000'000));
+}
+
+void print_peer(FILE *const f, const uint32_t a)
+{
+    fprintf(f, "%u.%u.%u.%u", a >> 24, a >> 16 & 0xff, a >> 8 & 0xff, a & 0xff);
+}
+
+void print_text(const std::vector<decoded> &rs)
+{
+    for (const auto &[r, tgt] : rs) {
+        print_time(stdout, r.time);
+        putchar(' ');
+        print_peer(stdout, r.peer);
+        const auto m = method_name(r.method);
+        printf(" %.*s %s %u %u", static_cast<int>(m.size()), m.data(), tgt->c_str(), r.status,
+               r.bytes);
+        for (auto p = 0_uz; p < alog::nphases; ++p)
+            printf(" %s=%uns", alog::phase_names[p].data(), r.lat[p]);
+        putchar('\n');
+    }
+}
+
+void print_csv(const std::vector<decoded> &rs)
+{
+    printf("time,peer,method,target,status,bytes");
+    for (const auto p : alog::phase_names)
+        printf(",%s_ns", p.data());
+    putchar('\n');
+    for (const auto &[r, tgt] : rs) {
+        print_time(stdout, r.time);
+        putchar(',');
+        print_peer(stdout, r.peer);
+        const auto m = method_name(r.method);
+        printf(",%.*s,\"", static_cast<int>(m.size()), m.data());
+        for (const auto c : *tgt)
+            c == '"' ? (void)fputs("\"\"", stdout) : (void)putchar(c);
+        printf("\",%u,%u", r.status, r.bytes);
+        for (const auto l : r.lat)
+            printf(",%u", l);
+        putchar('\n');
+    }
+}
+
+//! @brief Value at quantile q of sorted values
+uint64_t quantile(const std::vector<uint64_t> &v, const double q)
+{
+    return v.empty() ? 0 : v[std::min(v.size() - 1, static_cast<std::size_t>(q * v.size()))];
+}
+
+void print_stats(const std::vector<decoded> &rs)
+{
+    if (rs.empty()) {
+        printf("no requests\n");
+        return;
+    }
+    const auto [tf, tl] = sr::minmax(rs, {}, L(x.r.time));
+    uint64_t bytes      = 0;
+    std::map<uint16_t, uint64_t> statuses;
+    struct per_target {
+        uint64_t n = 0, bytes = 0;
+        std::vector<uint64_t> lat;
+    };
+    std::map<std::string_view, per_target> targets;
+    std::array<std::vector<uint64_t>, alog::nphases> phases;
+    for (const auto &[r, tgt] : rs) {
+        bytes += r.bytes;
+        ++statuses[r.status];
+        auto &t = targets[*tgt];
+        ++t.n;
+        t.bytes += r.bytes;
+        uint64_t total = 0;
+        for (auto p = 0_uz; p < alog::nphases; ++p) {
+            phases[p].push_back(r.lat[p]);
+            total += r.lat[p];
+        }
+        t.lat.push_back(total);
+    }
+
+    const auto secs = static_cast<double>(tl.r.time - tf.r.time) / 1e9;
+    printf("requests: %zu over %.3f s (%.1f/s), %llu bytes\n", rs.size(), secs,
+           secs > 0 ? static_cast<double>(rs.size()) / secs : 0.0,
+           static_cast<unsigned long long>(bytes));
+    printf("\nstatus   count\n");
+    for (const auto &[s, n] : statuses)
+        printf("%6u %7llu\n", s, static_cast<unsigned long long>(n));
+    printf("\nphase      p50 ns     p90 ns     p99 ns     max ns\n");
+    for (auto p = 0_uz; p < alog::nphases; ++p) {
+        auto &v = phases[p];
+        sr::sort(v);
+        printf("%-5s %10llu %10llu %10llu %10llu\n", alog::phase_names[p].data(),
+               static_cast<unsigned long long>(quantile(v, .5)),
+               static_cast<unsigned long long>(quantile(v, .9)),
+               static_cast<unsigned long long>(quantile(v, .99)),
+               static_cast<unsigned long long>(v.back()));
+    }
+    printf("\n  count        bytes  p50 ns total  p99 ns total  target\n");
+    for (auto &[tgt, t] : targets) {
+        sr::sort(t.lat);
+        printf("%7llu %12llu %13llu %13llu  %.*s\n", static_cast<unsigned long long>(t.n),
+               static_cast<unsigned long long>(t.bytes),
+               static_cast<unsigned long long>(quantile(t.lat, .5)),
+               static_cast<unsigned long long>(quantile(t.lat, .99)),
+               static_cast<int>(tgt.size()), tgt.data());
+    }
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    auto out = output::text;
+    auto i   = 1;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1] == '-'; ++i)
+        if (!strcmp(argv[i], "--csv"))
+            out = output::csv;
+        else if (!strcmp(argv[i], "--stats"))
+            out = output::stats;
+        else
+            break;
+    if (i == argc) {
+        fprintf(stderr, "usage: %s [--csv | --stats] <alog-file>...\n", argv[0]);
+        return 1;
+    }
+
+    // Files are read in the order given, as targets may be defined in an earlier one
+    std::vector<decoded> rs;
+    for (; i < argc; ++i)
+        if (!read_file(argv[i], rs))
+            return 1;
+    sr::stable_sort(rs, {}, L(x.r.time));
+
+    switch (out) {
+    case output::text:
+        print_text(rs);
+        break;
+    case output::csv:
+        print_csv(rs);
+        break;
+    case output::stats:
+        print_stats(rs);
+        break;
+    }
+    return 0;
+}
+
+#include "../lmacro_end.h"
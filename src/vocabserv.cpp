@@ -1,7 +1,21 @@
 #include "vocabserv.h"
 
+#include <atomic>
+#include <errno.h>
 #include <filesystem>
+#include <limits.h>
 #include <stdio.h>
+#include <string.h>
+#include <string_view>
+#include <thread>
+#ifdef __linux__
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 #include "format.h"
 #include "server.h"
@@ -10,17 +24,110 @@ namespace sc = std::chrono;
 namespace sf = std::filesystem;
 
 detail::log g_log;
-detail::vocab g_vocab;
+alog::access_log g_alog;
+
+//! @brief Removes option `--<name>=<value>` from argv
+//! @return Pointer to the value, or nullptr if option wasn't given
+static const char *take_opt(int &argc, char **argv, const std::string_view name) noexcept
+{
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+        if (arg.size() > name.size() + 3 && arg.starts_with("--") &&
+            arg.substr(2, name.size()) == name && arg[name.size() + 2] == '=') {
+            std::copy(argv + i + 1, argv + argc, argv + i);
+            --argc;
+            return arg.data() + name.size() + 3;
+        }
+    }
+    return nullptr;
+}
 
 int main(int argc, char **argv)
 {
     try {
+        unsigned nworkers = std::thread::hardware_concurrency();
+        if (const auto v = take_opt(argc, argv, "workers"); v && sscanf(v, "%u", &nworkers) != 1) {
+            fprintf(stderr, "couldn't read worker count as int (\"%s\")\n", v);
+            return 1;
+        }
+        auto load = detail::load_mode::read;
+        if (const auto v = take_opt(argc, argv, "load")) {
+            constexpr std::string_view modes[]{"read", "mmap", "mlock"};
+            const auto it = sr::find(modes, std::string_view{v});
+            if (it == sr::end(modes)) {
+                fprintf(stderr, "unknown load mode \"%s\" (read, mmap, or mlock)\n", v);
+                return 1;
+            }
+            load = static_cast<detail::load_mode>(it - modes);
+        }
+        unsigned max_age = 0;
+        if (const auto v = take_opt(argc, argv, "max-age"); v && sscanf(v, "%u", &max_age) != 1) {
+            fprintf(stderr, "couldn't read max-age as int (\"%s\")\n", v);
+            return 1;
+        }
+
+        unsigned read_bufs = 1024;
+        if (const auto v = take_opt(argc, argv, "read-bufs");
+            v && sscanf(v, "%u", &read_bufs) != 1) {
+            fprintf(stderr, "couldn't read read-bufs as int (\"%s\")\n", v);
+            return 1;
+        }
+
+        auto sendfile = false;
+        if (const auto v = take_opt(argc, argv, "send")) {
+            constexpr std::string_view modes[]{"write", "sendfile"};
+            const auto it = sr::find(modes, std::string_view{v});
+            if (it == sr::end(modes)) {
+                fprintf(stderr, "unknown send mode \"%s\" (write or sendfile)\n", v);
+                return 1;
+            }
+            sendfile = it != modes;
+            if (sendfile && load == detail::load_mode::read) {
+                fprintf(stderr, "sending the vocab file needs it mapped (mmap or mlock)\n");
+                return 1;
+            }
+        }
+
+        unsigned max_conns = 0, max_inflight = 0;
+        if (const auto v = take_opt(argc, argv, "max-conns");
+            v && sscanf(v, "%u", &max_conns) != 1) {
+            fprintf(stderr, "couldn't read max-conns as int (\"%s\")\n", v);
+            return 1;
+        }
+        if (const auto v = take_opt(argc, argv, "max-inflight");
+            v && sscanf(v, "%u", &max_inflight) != 1) {
+            fprintf(stderr, "couldn't read max-inflight as int (\"%s\")\n", v);
+            return 1;
+        }
+        double rate_limit = 0, burst = 0;
+        if (const auto v = take_opt(argc, argv, "rate-limit")) {
+            // <requests/s>[,<burst>]; a second's worth of requests by default
+            const auto n = sscanf(v, "%lf,%lf", &rate_limit, &burst);
+            if (n < 1 || rate_limit < 0 || burst < 0) {
+                fprintf(stderr, "couldn't read rate-limit as <requests/s>[,<burst>] (\"%s\")\n",
+                        v);
+                return 1;
+            }
+            if (n == 1)
+                burst = rate_limit;
+        }
+
         if (argc < 2) {
-            fprintf(stderr, "usage: %s <vocab-path> [<port-num>] [<log-dir>]\n", argv[0]);
+            fprintf(stderr,
+                    "usage: %s [--workers=<n>] [--max-age=<secs>] [--load=<read|mmap|mlock>] "
+                    "[--read-bufs=<n>] [--send=<write|sendfile>] [--max-conns=<n>] "
+                    "[--max-inflight=<n>] [--rate-limit=<requests/s>[,<burst>]] <vocab-path> "
+                    "[<port-num>] [<log-dir>]\n"
+                    "--max-conns and --max-inflight are split evenly among the workers, each\n"
+                    "of which gets n/workers (rounded up); --max-inflight counts the requests\n"
+                    "of connections other than the one being served, so that a client's own\n"
+                    "pipeline never sheds itself\n",
+                    argv[0]);
             return 1;
         }
 
-        if (!g_vocab.init(argv[1])) {
+        auto vocab = std::make_shared<detail::vocab>();
+        if (!vocab->init(argv[1], load, sendfile)) {
             fprintf(stderr, "couldn't open vocab file \"%s\"\n", argv[1]);
             return 1;
         }
@@ -33,13 +140,16 @@ int main(int argc, char **argv)
 
         if (argc < 4)
             g_log.init();
-        else if (!g_log.init(argv[3])) {
+        else if (!g_log.init(argv[3]) || !g_alog.init(argv[3])) {
             fprintf(stderr, "couldn't open log file \"%s\"\n", argv[3]);
             return 1;
         }
 
-        DBGEXPR(printf("server will run on 0.0.0.0:%hu...\n", port));
-        run_server({boost::asio::ip::address_v4{0}, static_cast<boost::asio::ip::port_type>(port)});
+        DBGEXPR(printf("server will run on 0.0.0.0:%hu with %u workers...\n", port, nworkers));
+        run_server({boost::asio::ip::address_v4{0}, static_cast<boost::asio::ip::port_type>(port)},
+                   {nworkers, argv[1], load, max_age, read_bufs, sendfile, max_conns, max_inflight,
+                    rate_limit, burst},
+                   std::move(vocab));
 
         return 0;
     } catch (const std::exception &e) {
@@ -48,7 +158,24 @@ int main(int argc, char **argv)
     }
 }
 
-bool detail::vocab::init(const char *path)
+//! @brief 64-bit hash of given bytes; not cryptographic, only tells contents apart
+[[nodiscard]] static uint64_t hash_bytes(const char *p, std::size_t n) noexcept
+{
+    uint64_t h = 0x9e3779b97f4a7c15 ^ n;
+    for (; n >= 8; p += 8, n -= 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        h = (h ^ w) * 0xff51afd7ed558ccd;
+        h ^= h >> 32;
+    }
+    for (; n; --n)
+        h = (h ^ static_cast<unsigned char>(*p++)) * 0x100000001b3;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53;
+    return h ^ (h >> 33);
+}
+
+bool detail::vocab::read_file(const char *path)
 {
     const auto file = fopen(path, "rb");
     if (!file)
@@ -57,17 +184,196 @@ bool detail::vocab::init(const char *path)
     fseek(file, 0, SEEK_END);
     const auto sz = static_cast<std::size_t>(ftell(file));
     fseek(file, 0, SEEK_SET);
-    buf  = std::make_unique_for_overwrite<char[]>(sz);
-    nbuf = static_cast<std::size_t>(fread(buf.get(), sizeof(char), sz, file));
+    heap = std::make_unique_for_overwrite<char[]>(sz);
+    nbuf = static_cast<std::size_t>(fread(heap.get(), sizeof(char), sz, file));
+    buf  = heap.get();
+    return true;
+}
+
+#ifdef __linux__
+bool detail::vocab::map_file(const char *path, const load_mode mode, const bool keep_open)
+{
+    const int f = open(path, O_RDONLY | O_CLOEXEC);
+    if (f == -1)
+        return false;
+    DEFER[&] {
+        if (f != fd)
+            close(f);
+    };
+    struct stat st;
+    if (fstat(f, &st) == -1)
+        return false;
+    if (st.st_size == 0) // an empty range can't be mapped
+        return read_file(path);
+    nbuf         = static_cast<std::size_t>(st.st_size);
+    const auto p = mmap(nullptr, nbuf, PROT_READ, MAP_SHARED, f, 0);
+    if (p == MAP_FAILED)
+        return false;
+    map = p;
+    buf = static_cast<const char *>(p);
+    if (keep_open) {
+        fd    = f;
+        mtime = st.st_mtim;
+    }
+
+    // The whole file is about to be hashed and indexed, so it's read ahead in full; huge pages
+    // are only used if the kernel supports them for file mappings, and the hint is harmless if not
+    madvise(p, nbuf, MADV_WILLNEED);
+#ifdef MADV_HUGEPAGE
+    madvise(p, nbuf, MADV_HUGEPAGE);
+#endif
+    if (mode == load_mode::lock && mlock(p, nbuf) == -1)
+        g_log.print("couldn't lock vocab into memory: ", std::string_view{strerror(errno)});
     return true;
 }
 
-bool detail::log::init(const char *dir)
+bool detail::vocab::file_unchanged() const noexcept
+{
+    struct stat st;
+    return fstat(fd, &st) == 0 && static_cast<std::size_t>(st.st_size) == nbuf &&
+           st.st_mtim.tv_sec == mtime.tv_sec && st.st_mtim.tv_nsec == mtime.tv_nsec;
+}
+
+detail::vocab::~vocab()
+{
+    if (map)
+        munmap(map, nbuf);
+    if (fd != -1)
+        close(fd);
+}
+#else
+bool detail::vocab::map_file(const char *path, load_mode, bool) { return read_file(path); }
+
+bool detail::vocab::file_unchanged() const noexcept { return true; }
+
+detail::vocab::~vocab() = default;
+#endif
+
+bool detail::vocab::init(const char *path, const load_mode mode, const bool keep_open)
+{
+    static std::atomic<uint64_t> nver = 0;
+    ver = ++nver;
+
+    if (!(mode == load_mode::read ? read_file(path) : map_file(path, mode, keep_open)))
+        return false;
+
+    // The index is built over the plain text
+    gzipped = nbuf >= 2 && buf[0] == '\x1f' && buf[1] == '\x8b';
+    if (!gzipped) {
+        text = {buf, nbuf};
+        return idx.build(text);
+    }
+    std::size_t nplain;
+    if (!gunzip(buf, nbuf, plain, nplain))
+        return false;
+    text = {plain.get(), nplain};
+    return idx.build(text);
+}
+
+//! @brief Sets an entity tag derived from the contents, so that reloading identical contents
+//! keeps client caches valid
+static void set_etag(std::array<char, 18> &etag, const std::string_view data) noexcept
+{
+    const auto h = hash_bytes(data.data(), data.size());
+    etag[0] = etag[17] = '"';
+    for (auto i = 0; i < 16; ++i)
+        etag[16 - i] = "0123456789abcdef"[h >> (i * 4) & 0xf];
+}
+
+detail::vocab_codings::vocab_codings(const vocab &v)
+{
+    data[static_cast<std::size_t>(coding::identity)] = v.text;
+    if (v.gzipped)
+        data[static_cast<std::size_t>(coding::gzip)] = {v.buf, v.nbuf};
+    for (auto c = 0_uz; c < ncodings; ++c)
+        if (c == static_cast<std::size_t>(coding::identity) || !data[c].empty())
+            set_etag(etags[c], data[c]);
+}
+
+void detail::vocab_codings::compress_missing()
+{
+    std::array<std::jthread, ncodings> ts;
+    for (auto c = 1_uz; c < ncodings; ++c) {
+        if (!data[c].empty())
+            continue;
+        ts[c] = std::jthread{[this, c] {
+            std::size_t n;
+            const auto identity = data[static_cast<std::size_t>(coding::identity)];
+            if (!compress(static_cast<coding>(c), identity, owned[c], n)) {
+                owned[c].reset();
+                return;
+            }
+            data[c] = {owned[c].get(), n};
+            set_etag(etags[c], data[c]);
+        }};
+    }
+}
+
+#ifdef __linux__
+detail::vocab_watch::vocab_watch(const char *const path, const bool renames_only) : path{path}
+{
+    // The directory is watched, as editors tend to replace files rather than modify them
+    const auto dir  = this->path.parent_path();
+    const auto mask = renames_only ? IN_MOVED_TO : IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE;
+    fd              = inotify_init1(IN_CLOEXEC);
+    if (fd != -1 && inotify_add_watch(fd, dir.empty() ? "." : dir.c_str(), mask) == -1) {
+        close(fd);
+        fd = -1;
+    }
+}
+
+detail::vocab_watch::~vocab_watch()
+{
+    if (fd != -1)
+        close(fd);
+}
+
+bool detail::vocab_watch::wait()
+{
+    if (fd == -1)
+        return false;
+    const auto name = path.filename();
+    alignas(inotify_event) char buf[4096];
+    for (bool hit = false;;) {
+        pollfd pfd{fd, POLLIN, 0};
+        const auto r = poll(&pfd, 1, hit ? 200 : -1);
+        if (r == 0)
+            return true; // settled
+        if (r < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        const auto n = read(fd, buf, sizeof(buf));
+        if (n <= 0)
+            return false;
+        for (auto p = buf; p < buf + n;) {
+            const auto e = reinterpret_cast<const inotify_event *>(p);
+            hit |= e->len && name == e->name;
+            p += sizeof(inotify_event) + e->len;
+        }
+    }
+}
+#else
+detail::vocab_watch::vocab_watch(const char *const path, bool) : path{path}
+{
+    std::error_code ec;
+    mtime = sf::last_write_time(this->path, ec);
+}
+
+detail::vocab_watch::~vocab_watch() = default;
+
+bool detail::vocab_watch::wait()
 {
-    const auto id = static_cast<std::size_t>(
-        std::distance(sf::directory_iterator{dir}, sf::directory_iterator{}));
-    const auto date = sc::time_point_cast<sc::seconds>(sc::system_clock::now());
-    char path[64];
-    format::format(path, std::string_view{dir}, "/", id, ".log\0");
-    return (file = fopen(path, "w"));
+    // No portable change notifications; poll the modification time
+    for (;;) {
+        std::this_thread::sleep_for(sc::seconds{1});
+        std::error_code ec;
+        if (const auto t = sf::last_write_time(path, ec); !ec && t != mtime) {
+            mtime = t;
+            std::this_thread::sleep_for(sc::milliseconds{200});
+            return true;
+        }
+    }
 }
+#endif
@@ -3,39 +3,93 @@
 #include <chrono>
 #include <filesystem>
 #include <memory>
-#include <mutex>
+#include <time.h>
 
+#include "access_log.h"
 #include "buffer.h"
+#include "coding.h"
 #include "jutil.h"
+#include "log.h"
+#include "search.h"
 
 namespace detail
 {
+//! @brief How the vocab file is brought into memory
+//!
+//! A mapped file must be replaced by rename: rewriting it in place would change the bytes under
+//! the index and entity tags of the snapshot serving it, and truncating it would fault readers
+//! with SIGBUS. In-place modifications of a mapped file are thus not reloaded.
+enum class load_mode {
+    read, // copied onto the heap
+    map,  // mapped, sharing the pages of the page cache (and of other processes mapping the file)
+    lock, // mapped and locked into memory
+};
+
+//! @brief Snapshot of the vocab file; read-only (thus freely shared) once loaded
 struct vocab {
-    bool init(const char *path);
-    std::unique_ptr<char[]> buf;
-    std::size_t nbuf;
+    vocab() = default;
+    ~vocab();
+    NO_COPY_MOVE(vocab);
+
+    //! @param keep_open Whether to keep a mapped file open as `fd`, for `buf` to be sent from it
+    bool init(const char *path, load_mode mode, bool keep_open = false);
+    uint64_t ver; // increases with every load
+    const char *buf = nullptr; // file contents, served as-is; points to `heap` or to the mapping
+    std::size_t nbuf = 0;
+    int fd = -1; // the mapped file, if kept open
+    timespec mtime{}; // of the file kept open, as loaded
+
+    //! @brief Whether the file kept open still has the size and modification time it was loaded
+    //! with, i.e. hasn't been rewritten in place since (as it mustn't be)
+    [[nodiscard]] bool file_unchanged() const noexcept;
+    bool gzipped;
+    std::unique_ptr<char[]> plain; // decompressed contents if the file is gzipped
+    std::string_view text;         // plain text; either `buf` or `plain`
+    search::index idx;
+
+  private:
+    bool read_file(const char *path);
+    bool map_file(const char *path, load_mode mode, bool keep_open);
+    std::unique_ptr<char[]> heap;
+    void *map = nullptr;
 };
 
-struct log {
-    JUTIL_INLINE bool init() const noexcept { return true; }
-    bool init(const char *dir);
-    template <class... Args>
-    JUTIL_INLINE void print(Args &&...args) noexcept
-    {
-        std::scoped_lock lk{mtx};
-        const auto len = buf.put(static_cast<Args &&>(args)..., "\n");
-        fwrite(buf.data(), sizeof(char), len, file);
-    }
-    ~log()
-    {
-        if (file != stdout)
-            fclose(file);
-    }
-    buffer buf;
-    std::mutex mtx;
-    FILE *file = stdout;
+//! @brief Contents of a vocab in every coding it's served in, along with their entity tags
+struct vocab_codings {
+    //! @brief References the codings at hand: identity, and gzip if the file is gzipped
+    explicit vocab_codings(const vocab &v);
+
+    //! @brief Compresses the contents into the codings not at hand, each on its own thread
+    void compress_missing();
+
+    std::array<std::string_view, ncodings> data; // empty if not available (except identity)
+    std::array<std::array<char, 18>, ncodings> etags; // strong validators, quoted
+
+  private:
+    std::array<std::unique_ptr<char[]>, ncodings> owned;
+};
+
+//! @brief Watches the vocab file for modifications, including replacement by rename
+struct vocab_watch {
+    //! @param renames_only Whether to only watch for replacement by rename, as for a mapped file,
+    //! whose in-place rewrites can't be reloaded from safely
+    explicit vocab_watch(const char *path, bool renames_only = false);
+    ~vocab_watch();
+    NO_COPY_MOVE(vocab_watch);
+
+    //! @brief Blocks until the file has been modified and has stayed unmodified for a moment
+    //! @return Whether watching can continue
+    bool wait();
+
+    std::filesystem::path path;
+#ifdef __linux__
+    int fd = -1;
+#else
+    std::filesystem::file_time_type mtime;
+#endif
 };
+
 } // namespace detail
 
 extern detail::log g_log;
-extern detail::vocab g_vocab;
+extern alog::access_log g_alog;